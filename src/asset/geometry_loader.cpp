@@ -3,6 +3,7 @@
 #include "geometry_loader.h"
 
 #include "asset_system.h"
+#include "geometry_optimizer.h"
 
 using namespace std;
 
@@ -66,6 +67,12 @@ namespace
             make_tris(asset, name);
         else
             throw std::runtime_error(print_fmt("unknown static geometry, name = %s", name.c_str()).c_str());
+
+        for (auto& obj : m_objects)
+        {
+            optimize_geometry(obj);
+            build_meshlets(obj);
+        }
     }
 
     const string& PrefabGeometry::get_name() const
@@ -145,7 +152,7 @@ namespace
         for (size_t i = 0; i < index_count; i++)
         {
             const size_t fi = i / 6;
-            obj.indices[i] = static_cast<uint16_t>(4 * fi) + indices[i % face_index_count];
+            obj.indices[i] = static_cast<uint32_t>(4 * fi) + indices[i % face_index_count];
         }
 
         // material
@@ -284,7 +291,10 @@ namespace
     constexpr uint16_t M3DS_MATERIAL_TEX = 0xa200;
     constexpr uint16_t M3DS_MATERIAL_TEXFILE = 0xa300;
     // addressing modes and other options
-    // constexpr uint16_t M3DS_MATERIAL_FILE_FLAGS = 0xa351;
+    constexpr uint16_t M3DS_MATERIAL_FILE_FLAGS = 0xa351;
+    constexpr uint16_t M3DS_MAP_DECAL = 0x0001;
+    constexpr uint16_t M3DS_MAP_MIRROR = 0x0002;
+    constexpr uint16_t M3DS_MAP_NO_TILE = 0x0010;
 
     constexpr uint16_t M3DS_OBJECT = 0x4000;
     constexpr uint16_t M3DS_OBJECT_MESH = 0x4100;
@@ -333,6 +343,7 @@ namespace
             void compute_smoothing();
             void read_texcoords();
             void read_object_material();
+            void read_material_file_flags();
 
         private:
             AssetSystem& m_asset;
@@ -463,6 +474,11 @@ namespace
                     //dlog("3ds material texture file = %s", m_mat->tex_filename.c_str());
                     break;
 
+                case M3DS_MATERIAL_FILE_FLAGS:
+                    read_material_file_flags();
+                    dlog("3ds material texture tiling = %d", static_cast<int>(m_mat->diffuse_tiling));
+                    break;
+
                 default:
                     skip(ch);
                     break;
@@ -694,12 +710,32 @@ namespace
         }
     }
 
+    void Max3dsGeometry::Parser::read_material_file_flags()
+    {
+        uint16_t flags;
+        read(&flags);
+
+        // NOTE: 3ds tiles the map unless told otherwise, decals are not tiled either
+        if (flags & M3DS_MAP_MIRROR)
+            m_mat->diffuse_tiling = MapTiling::Mirror;
+        else if (flags & (M3DS_MAP_NO_TILE | M3DS_MAP_DECAL))
+            m_mat->diffuse_tiling = MapTiling::Clamp;
+        else
+            m_mat->diffuse_tiling = MapTiling::Repeat;
+    }
+
     Max3dsGeometry::Max3dsGeometry(AssetSystem& asset, const string& filename) :
         m_name(filename)
     {
         flog("id = %#x", this);
         Parser{ asset, filename }.parse(m_objects, m_materials);
 
+        for (auto& obj : m_objects)
+        {
+            optimize_geometry(obj);
+            build_meshlets(obj);
+        }
+
         // TODO: this should be covered by config files
         if (filename.find("ship.3ds") != string::npos)
         {
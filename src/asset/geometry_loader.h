@@ -8,6 +8,23 @@ class ImageAsset;
 class GeometryAsset
 {
 public:
+    // NOTE: cluster of consecutive triangles in the index list with bounds for culling the whole
+    // cluster at once. All the triangle normals are within the cone around axis, cone_cos <= 0
+    // means the cone is too wide to ever be back-facing.
+    struct Meshlet
+    {
+        uint32_t first_index;
+        uint32_t index_count;
+
+        vec3 center;
+        float radius;
+
+        vec3 cone_axis;
+        float cone_cos;
+        float cone_sin;
+    };
+    using Meshlets = std::vector<Meshlet>;
+
     struct Object
     {
         std::string name;
@@ -17,16 +34,25 @@ public:
         std::vector<Color> colors;
         std::vector<vec3> normals;
         std::vector<vec2> texcoords;
-        std::vector<uint16_t> indices;
+        std::vector<uint32_t> indices;
+        Meshlets meshlets;
     };
     using Objects = std::vector<Object>;
 
+    enum class MapTiling
+    {
+        Clamp,
+        Repeat,
+        Mirror
+    };
+
     struct Material
     {
         std::string name;
         Color ambient, diffuse, specular, emissive;
         float shininess;
         std::shared_ptr<ImageAsset> diffuse_map;
+        MapTiling diffuse_tiling = MapTiling::Clamp;
     };
     using Materials = std::vector<Material>;
 
@@ -0,0 +1,429 @@
+
+#include "precompiled.h"
+#include "geometry_optimizer.h"
+
+using namespace std;
+
+namespace
+{
+    // triangles using each vertex, triangle lists of vertex v are in [offsets[v], offsets[v + 1])
+    struct Adjacency
+    {
+        vector<uint32_t> offsets;
+        vector<uint32_t> triangles;
+    };
+
+    Adjacency build_adjacency(const vector<uint32_t>& indices, size_t vertex_count)
+    {
+        Adjacency adj;
+        adj.offsets.assign(vertex_count + 1, 0);
+        adj.triangles.resize(indices.size());
+
+        for (auto index : indices)
+            adj.offsets[index + 1] ++;
+        for (size_t i = 0; i < vertex_count; i++)
+            adj.offsets[i + 1] += adj.offsets[i];
+
+        vector<uint32_t> cursor{ adj.offsets.begin(), adj.offsets.end() - 1 };
+        for (size_t i = 0; i < indices.size(); i++)
+            adj.triangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+        return adj;
+    }
+
+    // tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander et al.)
+    // returns the triangle order, cluster_starts gets the positions where the walk jumped to a
+    // disconnected vertex; those are the cluster boundaries used for the overdraw sort
+    vector<uint32_t> tipsify(const vector<uint32_t>& indices, size_t vertex_count, vector<size_t>& cluster_starts)
+    {
+        const int cache_size = static_cast<int>(detail::GEOMETRY_CACHE_SIZE);
+        const size_t triangle_count = indices.size() / 3;
+        const Adjacency adj = build_adjacency(indices, vertex_count);
+
+        // live triangle count and cache timestamp per vertex
+        vector<int> live(vertex_count);
+        for (size_t v = 0; v < vertex_count; v++)
+            live[v] = static_cast<int>(adj.offsets[v + 1] - adj.offsets[v]);
+        vector<int> cache_time(vertex_count, 0);
+
+        vector<bool> emitted(triangle_count, false);
+        vector<uint32_t> dead_ends;
+        vector<uint32_t> candidates;
+
+        vector<uint32_t> order;
+        order.reserve(triangle_count);
+
+        int time = cache_size + 1;
+        size_t cursor = 0;
+
+        const auto skip_dead_end = [&]() -> int
+        {
+            // recently used vertices first, they might still be in cache
+            while (!dead_ends.empty())
+            {
+                const uint32_t v = dead_ends.back();
+                dead_ends.pop_back();
+                if (live[v] > 0)
+                    return static_cast<int>(v);
+            }
+
+            for (; cursor < vertex_count; cursor++)
+            {
+                if (live[cursor] > 0)
+                    return static_cast<int>(cursor);
+            }
+            return -1;
+        };
+
+        int fan = skip_dead_end();
+        if (fan >= 0)
+            cluster_starts.push_back(0);
+
+        while (fan >= 0)
+        {
+            candidates.clear();
+
+            // emit all the remaining triangles around the fanning vertex
+            for (uint32_t a = adj.offsets[fan]; a < adj.offsets[fan + 1]; a++)
+            {
+                const uint32_t t = adj.triangles[a];
+                if (emitted[t])
+                    continue;
+
+                for (size_t k = 0; k < 3; k++)
+                {
+                    const uint32_t v = indices[t * 3 + k];
+                    dead_ends.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+
+                    if (time - cache_time[v] > cache_size)
+                        cache_time[v] = time++;
+                }
+
+                emitted[t] = true;
+                order.push_back(t);
+            }
+
+            // next fanning vertex, the one that stays in cache the longest if it gets picked
+            int next = -1;
+            int best = -1;
+            for (auto v : candidates)
+            {
+                if (live[v] <= 0)
+                    continue;
+
+                int priority = 0;
+                if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                    priority = time - cache_time[v];
+
+                if (priority > best)
+                {
+                    best = priority;
+                    next = static_cast<int>(v);
+                }
+            }
+
+            if (next < 0)
+            {
+                next = skip_dead_end();
+                if (next >= 0 && order.size() < triangle_count)
+                    cluster_starts.push_back(order.size());
+            }
+
+            fan = next;
+        }
+
+        return order;
+    }
+
+    // sorts the clusters so the ones facing away from the object center get drawn first,
+    // those are the most likely to occlude the rest from any viewpoint
+    vector<uint32_t> sort_clusters(
+        const vector<uint32_t>& order, const vector<size_t>& cluster_starts,
+        const vector<uint32_t>& indices, const vector<vec3>& vertices)
+    {
+        vec3 center;
+        for (auto& v : vertices)
+            center += v;
+        center *= 1.0f / static_cast<float>(vertices.size());
+
+        struct Cluster
+        {
+            size_t first, last;
+            float facing;
+        };
+
+        vector<Cluster> clusters;
+        clusters.reserve(cluster_starts.size());
+        for (size_t c = 0; c < cluster_starts.size(); c++)
+        {
+            const size_t first = cluster_starts[c];
+            const size_t last = c + 1 < cluster_starts.size() ? cluster_starts[c + 1] : order.size();
+
+            // area weighted normal and centroid
+            vec3 normal, centroid;
+            float area = 0.0f;
+            for (size_t i = first; i < last; i++)
+            {
+                const vec3& v0 = vertices[indices[order[i] * 3 + 0]];
+                const vec3& v1 = vertices[indices[order[i] * 3 + 1]];
+                const vec3& v2 = vertices[indices[order[i] * 3 + 2]];
+
+                const vec3 v10 = v1 - v0;
+                const vec3 v20 = v2 - v0;
+                const vec3 n = v10 ^ v20;
+                const float a = n.length();
+
+                normal += n;
+                centroid += (v0 + v1 + v2) * (a / 3.0f);
+                area += a;
+            }
+
+            const float facing = area > 0 ?
+                (centroid * (1.0f / area) - center) * normal.normalize() :
+                -numeric_limits<float>::max();
+            clusters.push_back({ first, last, facing });
+        }
+
+        stable_sort(
+            clusters.begin(), clusters.end(),
+            [](const Cluster& a, const Cluster& b) { return a.facing > b.facing; }
+        );
+
+        vector<uint32_t> ret;
+        ret.reserve(order.size());
+        for (auto& c : clusters)
+            ret.insert(ret.end(), order.begin() + c.first, order.begin() + c.last);
+        return ret;
+    }
+
+    template <typename T>
+    void remap_attribute(vector<T>& attr, const vector<uint32_t>& remap, size_t count)
+    {
+        if (attr.empty())
+            return;
+
+        vector<T> ret(count);
+        for (size_t i = 0; i < attr.size(); i++)
+        {
+            if (remap[i] != numeric_limits<uint32_t>::max())
+                ret[remap[i]] = attr[i];
+        }
+        attr.swap(ret);
+    }
+
+    // renumbers the vertices in first use order of the index list and drops the unused ones
+    void remap_first_use(GeometryAsset::Object& object)
+    {
+        vector<uint32_t> remap(object.vertices.size(), numeric_limits<uint32_t>::max());
+        uint32_t used = 0;
+        for (auto& index : object.indices)
+        {
+            if (remap[index] == numeric_limits<uint32_t>::max())
+                remap[index] = used++;
+            index = remap[index];
+        }
+
+        remap_attribute(object.vertices, remap, used);
+        remap_attribute(object.colors, remap, used);
+        remap_attribute(object.normals, remap, used);
+        remap_attribute(object.texcoords, remap, used);
+    }
+
+#ifdef _DEBUG
+    // average cache miss ratio of a fifo cache, misses per triangle
+    float compute_acmr(const vector<uint32_t>& indices, size_t vertex_count)
+    {
+        vector<size_t> cache_time(vertex_count, 0);
+        size_t time = detail::GEOMETRY_CACHE_SIZE + 1;
+        size_t misses = 0;
+
+        for (auto v : indices)
+        {
+            if (time - cache_time[v] > detail::GEOMETRY_CACHE_SIZE)
+            {
+                cache_time[v] = time++;
+                misses++;
+            }
+        }
+        return indices.empty() ? 0.0f : static_cast<float>(misses) / (indices.size() / 3);
+    }
+#endif
+
+    // unit normal of the front face, zero for degenerate triangles
+    vec3 get_face_normal(const GeometryAsset::Object& object, size_t triangle)
+    {
+        const vec3& v0 = object.vertices[object.indices[triangle * 3 + 0]];
+        const vec3& v1 = object.vertices[object.indices[triangle * 3 + 1]];
+        const vec3& v2 = object.vertices[object.indices[triangle * 3 + 2]];
+
+        const vec3 v10 = v1 - v0;
+        const vec3 v20 = v2 - v0;
+        return (v10 ^ v20).normalize();
+    }
+
+    GeometryAsset::Meshlet make_meshlet(const GeometryAsset::Object& object, size_t first, size_t last)
+    {
+        GeometryAsset::Meshlet m;
+        m.first_index = static_cast<uint32_t>(first * 3);
+        m.index_count = static_cast<uint32_t>((last - first) * 3);
+
+        // sphere around the bounding box center, close enough for culling
+        vec3 lo{ numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max() };
+        vec3 hi = -lo;
+        for (uint32_t i = m.first_index; i < m.first_index + m.index_count; i++)
+        {
+            const vec3& v = object.vertices[object.indices[i]];
+            lo = vec3{ ::min(lo.x(), v.x()), ::min(lo.y(), v.y()), ::min(lo.z(), v.z()) };
+            hi = vec3{ ::max(hi.x(), v.x()), ::max(hi.y(), v.y()), ::max(hi.z(), v.z()) };
+        }
+
+        m.center = (lo + hi) * 0.5f;
+        m.radius = 0.0f;
+        for (uint32_t i = m.first_index; i < m.first_index + m.index_count; i++)
+            m.radius = ::max(m.radius, (object.vertices[object.indices[i]] - m.center).length());
+
+        // cone around the average normal that holds all the others
+        vec3 axis;
+        for (size_t t = first; t < last; t++)
+            axis += get_face_normal(object, t);
+        m.cone_axis = axis.normalize();
+
+        m.cone_cos = m.cone_axis.length_sq() > 0 ? 1.0f : -1.0f;
+        for (size_t t = first; t < last; t++)
+        {
+            const vec3 n = get_face_normal(object, t);
+            if (n.length_sq() > 0)
+                m.cone_cos = ::min(m.cone_cos, n * m.cone_axis);
+        }
+        m.cone_sin = sqrt(::max(1.0f - m.cone_cos * m.cone_cos, 0.0f));
+
+        return m;
+    }
+}
+
+void optimize_geometry(GeometryAsset::Object& object)
+{
+    auto& indices = object.indices;
+    const size_t vertex_count = object.vertices.size();
+    if (indices.size() < 3 || vertex_count == 0)
+        return;
+
+#ifdef _DEBUG
+    const float acmr_before = compute_acmr(indices, vertex_count);
+#endif
+
+    // triangle order
+    vector<size_t> cluster_starts;
+    const vector<uint32_t> tipsified = tipsify(indices, vertex_count, cluster_starts);
+    const vector<uint32_t> order = sort_clusters(tipsified, cluster_starts, indices, object.vertices);
+
+    vector<uint32_t> ordered(order.size() * 3);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        ordered[i * 3 + 0] = indices[order[i] * 3 + 0];
+        ordered[i * 3 + 1] = indices[order[i] * 3 + 1];
+        ordered[i * 3 + 2] = indices[order[i] * 3 + 2];
+    }
+
+    indices.swap(ordered);
+    remap_first_use(object);
+
+#ifdef _DEBUG
+    dlog("Optimized geometry %s, acmr %.3f -> %.3f, %d clusters, vertices %d -> %d",
+        object.name.c_str(), acmr_before, compute_acmr(indices, object.vertices.size()),
+        cluster_starts.size(), vertex_count, object.vertices.size());
+#endif
+}
+
+void build_meshlets(GeometryAsset::Object& object)
+{
+    auto& indices = object.indices;
+    auto& meshlets = object.meshlets;
+    meshlets.clear();
+
+    const size_t triangle_count = indices.size() / 3;
+    const Adjacency adj = build_adjacency(indices, object.vertices.size());
+    const float max_spread = cos(detail::MESHLET_MAX_CONE_ANGLE * PI / 180.0f);
+
+    vector<vec3> normals(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++)
+        normals[t] = get_face_normal(object, t);
+
+    vector<bool> assigned(triangle_count, false);
+    vector<uint32_t> members, frontier;
+    vector<uint32_t> ordered;
+    ordered.reserve(indices.size());
+    vector<size_t> meshlet_starts;
+
+    // NOTE: greedy growth over shared vertices, picking the neighbour closest to the average normal;
+    // seeds follow the optimized order and triangles keep their relative order within a meshlet, so
+    // most of the cache and overdraw ordering survives
+    for (uint32_t seed = 0; seed < triangle_count; seed++)
+    {
+        if (assigned[seed])
+            continue;
+
+        members.clear();
+        frontier.clear();
+        vec3 normal_sum;
+
+        uint32_t next = seed;
+        while (true)
+        {
+            assigned[next] = true;
+            members.push_back(next);
+            normal_sum += normals[next];
+
+            if (members.size() == detail::MESHLET_MAX_TRIANGLES)
+                break;
+
+            for (size_t k = 0; k < 3; k++)
+            {
+                const uint32_t v = indices[next * 3 + k];
+                for (uint32_t a = adj.offsets[v]; a < adj.offsets[v + 1]; a++)
+                {
+                    if (!assigned[adj.triangles[a]])
+                        frontier.push_back(adj.triangles[a]);
+                }
+            }
+
+            // degenerate triangles have no normal and fit anywhere
+            const vec3 axis = normal_sum.normalize();
+            float best = max_spread;
+            bool found = false;
+            for (auto t : frontier)
+            {
+                const float facing = normals[t].length_sq() > 0 ? normals[t] * axis : 1.0f;
+                if (!assigned[t] && facing >= best)
+                {
+                    best = facing;
+                    next = t;
+                    found = true;
+                }
+            }
+
+            if (!found)
+                break;
+        }
+
+        sort(members.begin(), members.end());
+
+        meshlet_starts.push_back(ordered.size() / 3);
+        for (auto t : members)
+            ordered.insert(ordered.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+    }
+
+    // NOTE: regrouping moved triangles around, vertices go back to first use order for linear fetches
+    indices.swap(ordered);
+    remap_first_use(object);
+
+    for (size_t m = 0; m < meshlet_starts.size(); m++)
+    {
+        const size_t last = m + 1 < meshlet_starts.size() ? meshlet_starts[m + 1] : triangle_count;
+        meshlets.push_back(make_meshlet(object, meshlet_starts[m], last));
+    }
+
+    dlog("Built %d meshlets for geometry %s, %d triangles", meshlets.size(), object.name.c_str(), triangle_count);
+}
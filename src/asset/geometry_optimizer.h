@@ -0,0 +1,24 @@
+#pragma once
+
+#include "geometry_loader.h"
+
+// NOTE: load-time reordering of the object data, only the order things are drawn in changes:
+// - triangles are ordered for post-transform vertex cache hits (tipsify)
+// - the resulting triangle clusters are sorted so that outward facing ones go first, less overdraw
+// - vertices are renumbered in first use order so vertex fetch walks memory linearly, unused ones are dropped
+void optimize_geometry(GeometryAsset::Object& object);
+
+// NOTE: groups neighbouring triangles with similar normals in meshlets, each one a contiguous range of the
+// index list with a bounding sphere and normal cone, used to reject whole clusters that are outside the
+// frustum or back-facing; run after the optimization pass, it only regroups the order that one produced
+void build_meshlets(GeometryAsset::Object& object);
+
+namespace detail
+{
+    // post-transform cache size the triangle order is tuned for
+    constexpr size_t GEOMETRY_CACHE_SIZE = 16;
+
+    // triangles per meshlet, and the max normal spread (degrees off the average); curved parts close early
+    constexpr size_t MESHLET_MAX_TRIANGLES = 64;
+    constexpr float MESHLET_MAX_CONE_ANGLE = 15.0f;
+}
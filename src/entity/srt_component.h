@@ -48,10 +48,18 @@ public:
     const mat4& get_world();
     const mat4& get_world_inv();
 
+    // NOTE: static entities may be drawn once and cached by the renderer, every change
+    // bumps the version so the cache gets redrawn
+    void set_static(bool enable);
+    bool is_static() const;
+    uint32_t get_version() const;
+
 private:
     vec3 m_scale = { 1, 1, 1 };
     vec3 m_rotation = { 0, 0, 0 };
     vec3 m_position = { 0, 0, 0 };
+    bool m_static = false;
+    uint32_t m_version = 0;
     dirty_t<mat4, detail::make_world> m_world = { m_scale, m_rotation, m_position };
     dirty_t<mat4, detail::make_world_inv> m_world_inv = { m_scale, m_rotation, m_position };
 };
@@ -65,11 +73,13 @@ inline SrtComponent::SrtComponent(const SrtComponent& rhs)
     m_scale = rhs.m_scale;
     m_rotation = rhs.m_rotation;
     m_position = rhs.m_position;
+    m_static = rhs.m_static;
 }
 
 inline void SrtComponent::set_scale(const vec3& scale)
 {
     m_scale = scale;
+    m_version++;
     m_world.set_dirty();
     m_world_inv.set_dirty();
 }
@@ -82,6 +92,7 @@ inline const vec3& SrtComponent::get_scale() const
 inline void SrtComponent::set_rotation(const vec3& rotation)
 {
     m_rotation = rotation;
+    m_version++;
     m_world.set_dirty();
     m_world_inv.set_dirty();
 }
@@ -94,6 +105,7 @@ inline const vec3& SrtComponent::get_rotation() const
 inline void SrtComponent::set_position(const vec3& position)
 {
     m_position = position;
+    m_version++;
     m_world.set_dirty();
     m_world_inv.set_dirty();
 }
@@ -112,3 +124,19 @@ inline const mat4& SrtComponent::get_world_inv()
 {
     return m_world_inv.get();
 }
+
+inline void SrtComponent::set_static(bool enable)
+{
+    m_static = enable;
+    m_version++;
+}
+
+inline bool SrtComponent::is_static() const
+{
+    return m_static;
+}
+
+inline uint32_t SrtComponent::get_version() const
+{
+    return m_version;
+}
@@ -94,6 +94,11 @@ void Context::on_create()
 
     auto& srt_ship = m_objects[1]->get_component<SrtComponent>();
     srt_ship.set_scale({ .5, .5, .5 });
+
+    // everything but the rotating ones can be cached
+    size_t static_indices[] = { 0, 2, 3 };
+    for (size_t i : static_indices)
+        m_objects[i]->get_component<SrtComponent>().set_static(true);
 }
 
 void Context::on_destroy()
@@ -115,7 +120,10 @@ void Context::on_update()
 
     auto& keyboard = get_input().get_keyboard();
 
-    auto& dev = get_render().get_device();
+    auto& render = get_render();
+    auto& dev = render.get_device();
+    // NOTE: anything that changes how things get drawn makes the static layer stale
+    bool dev_changed = true;
     if (keyboard.get_key_pressed('1'))
         dev.set_polygon_mode(PolygonMode::Point);
     else if (keyboard.get_key_pressed('2'))
@@ -126,6 +134,37 @@ void Context::on_update()
         static_cast<SoftwareDevice&>(dev).debug_normals(true);
     else if (keyboard.get_key_pressed('5'))
         static_cast<SoftwareDevice&>(dev).debug_normals(false);
+    else if (keyboard.get_key_pressed('6'))
+        static_cast<SoftwareDevice&>(dev).set_lighting_quality(LightingQuality::Accurate);
+    else if (keyboard.get_key_pressed('7'))
+        static_cast<SoftwareDevice&>(dev).set_lighting_quality(LightingQuality::Fast);
+    else if (keyboard.get_key_pressed('8'))
+        static_cast<SoftwareDevice&>(dev).set_perspective_mode(PerspectiveMode::Exact);
+    else if (keyboard.get_key_pressed('9'))
+        static_cast<SoftwareDevice&>(dev).set_perspective_mode(PerspectiveMode::Subdivided);
+    else if (keyboard.get_key_pressed('z'))
+        static_cast<SoftwareDevice&>(dev).set_raster_mode(RasterMode::DepthBuffer);
+    else if (keyboard.get_key_pressed('x'))
+        static_cast<SoftwareDevice&>(dev).set_raster_mode(RasterMode::SpanBuffer);
+    else if (keyboard.get_key_pressed('c'))
+        static_cast<SoftwareDevice&>(dev).set_intermediate_format(ColorBufferFormat::RGB565);
+    else if (keyboard.get_key_pressed('v'))
+        static_cast<SoftwareDevice&>(dev).set_intermediate_format(ColorBufferFormat::RGBA16F);
+    else if (keyboard.get_key_pressed('b'))
+        static_cast<SoftwareDevice&>(dev).set_intermediate_format(m_target->get_color_buffer().get_format());
+    else if (keyboard.get_key_pressed('n'))
+        static_cast<SoftwareDevice&>(dev).set_frame_budget(1.0f / 30.0f);
+    else if (keyboard.get_key_pressed('m'))
+        static_cast<SoftwareDevice&>(dev).set_frame_budget(0.0f);
+    else if (keyboard.get_key_pressed('k'))
+        render.set_static_layer(true);
+    else if (keyboard.get_key_pressed('l'))
+        render.set_static_layer(false);
+    else
+        dev_changed = false;
+
+    if (dev_changed)
+        render.invalidate_static_layer();
 
     // TODO: translate keys to platform independent
     if (keyboard.get_key_pressed(KEY_ESCAPE))
@@ -153,6 +192,7 @@ void Context::on_render()
     vec2 r = m_camera.get_rotation() * (180.0f / PI);
     dev.draw_text(print_fmt("cam pos = %.4f %.4f %.4f", p.x(), p.y(), p.z()), 3, y += 10);
     dev.draw_text(print_fmt("cam rot = %.4f %.4f", r.x(), -r.y()), 3, y += 10);
+    dev.draw_text(print_fmt("res scale = %.4f", static_cast<SoftwareDevice&>(dev).get_resolution_scale()), 3, y += 10);
 }
 
 int main()
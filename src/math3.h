@@ -43,9 +43,36 @@ inline const T& max(const T& a, const Args&... args);
 template <typename T>
 inline T clamp(T value, T min_value, T max_value);
 
+// fast approximations for the lighting paths, error bounds are documented on the impls
+inline float fast_rsqrt(float x);
+inline float fast_log2(float x);
+inline float fast_exp2(float x);
+inline float fast_pow(float x, float y);
+
 // TODO: rename or move to namespace?
 struct no_init_tag {};
 
+// x^exponent for x in [0, 1], linearly interpolated from a table
+// NOTE: max abs error is (exponent^2 / 8) / POW_TABLE_SIZE^2, ~5e-3 for exponent 100
+class PowTable
+{
+public:
+    static constexpr size_t POW_TABLE_SIZE = 512;
+    // past this exponent the table error passes that of fast_pow
+    static constexpr float MAX_EXPONENT = 128.0f;
+
+public:
+    PowTable() = default;
+    explicit PowTable(float exponent);
+
+    float get_exponent() const;
+    float operator()(float x) const;
+
+private:
+    float m_exponent = 0.0f;
+    std::array<float, POW_TABLE_SIZE + 1> m_data;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // FixedPoint
 ///////////////////////////////////////////////////////////////////////////////
@@ -139,6 +166,8 @@ public:
     T length() const;
     T length_sq() const;
     vec normalize() const;
+    // uses fast_rsqrt, see there for the precision
+    vec normalize_fast() const;
 
     T& operator[](size_t index);
     T operator[](size_t index) const;
@@ -559,6 +588,86 @@ inline T clamp(T value, T min_value, T max_value)
     return value;
 }
 
+namespace detail
+{
+    inline uint32_t float_bits(float x)
+    {
+        uint32_t ret;
+        std::memcpy(&ret, &x, sizeof(ret));
+        return ret;
+    }
+
+    inline float bits_float(uint32_t x)
+    {
+        float ret;
+        std::memcpy(&ret, &x, sizeof(ret));
+        return ret;
+    }
+}
+
+// max relative error 5e-6, bit trick initial guess + two newton steps; x > 0
+// NOTE: a single step leaves 1.8e-3 which high specular powers amplify into visible banding
+inline float fast_rsqrt(float x)
+{
+    const float half_x = 0.5f * x;
+    float y = detail::bits_float(0x5f3759df - (detail::float_bits(x) >> 1));
+    y = y * (1.5f - half_x * y * y);
+    return y * (1.5f - half_x * y * y);
+}
+
+// max abs error 1.1e-4, exponent from the float bits + degree 4 polynomial on the mantissa; x > 0
+inline float fast_log2(float x)
+{
+    const uint32_t bits = detail::float_bits(x);
+    const float e = static_cast<float>(static_cast<int>((bits >> 23) & 0xff) - 127);
+    const float m = detail::bits_float((bits & 0x007fffff) | 0x3f800000) - 1.0f;
+
+    return e + m * (1.4390150f + m * (-0.6799478f + m * (0.3256051f + m * -0.0847750f)));
+}
+
+// max relative error 5.7e-6, integer part in the exponent bits + degree 4 polynomial on the fraction
+inline float fast_exp2(float x)
+{
+    x = clamp(x, -126.0f, 127.0f);
+
+    const float fi = floor(x);
+    const float f = x - fi;
+    const float p = 1.0f + f * (0.6930448f + f * (0.2412801f + f * (0.0522428f + f * 0.0134265f)));
+
+    return p * detail::bits_float(static_cast<uint32_t>(static_cast<int>(fi) + 127) << 23);
+}
+
+// x^y thru fast_exp2(y * fast_log2(x)), max relative error grows with y as ~7.5e-5 * y; x >= 0
+inline float fast_pow(float x, float y)
+{
+    if (x <= 0.0f)
+        return 0.0f;
+    return fast_exp2(y * fast_log2(x));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PowTable
+///////////////////////////////////////////////////////////////////////////////
+inline PowTable::PowTable(float exponent) :
+    m_exponent(exponent)
+{
+    for (size_t i = 0; i <= POW_TABLE_SIZE; i++)
+        m_data[i] = pow(static_cast<float>(i) / POW_TABLE_SIZE, exponent);
+}
+
+inline float PowTable::get_exponent() const
+{
+    return m_exponent;
+}
+
+inline float PowTable::operator()(float x) const
+{
+    const float pos = clamp(x, 0.0f, 1.0f) * POW_TABLE_SIZE;
+    const size_t index = ::min(static_cast<size_t>(pos), POW_TABLE_SIZE - 1);
+    const float t = pos - index;
+    return m_data[index] + (m_data[index + 1] - m_data[index]) * t;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // FixedPoint
 ///////////////////////////////////////////////////////////////////////////////
@@ -762,6 +871,18 @@ inline vec<T, N> vec<T, N>::normalize() const
     return ret;
 }
 
+template <typename T, size_t N>
+inline vec<T, N> vec<T, N>::normalize_fast() const
+{
+    vec ret;
+
+    T len_sq = length_sq();
+    if (len_sq > std::numeric_limits<float>::min())
+        return detail::iterate1<N, mul_op>()(ret, *this, static_cast<T>(fast_rsqrt(static_cast<float>(len_sq))));
+
+    return ret;
+}
+
 template <typename T, size_t N>
 inline T& vec<T, N>::operator[](size_t index)
 {
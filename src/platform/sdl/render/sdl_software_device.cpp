@@ -55,6 +55,10 @@ void SdlSoftwareDevice::draw_text(const std::string& text, int x, int y)
 
     SDL_Color fg = { 150, 0, 200 };
     SDL_Surface* text_surface = TTF_RenderText_Blended(m_font, text.c_str(), fg);
+    if (!text_surface)
+        return;
+
+    resolve_tiles(x, y, x + text_surface->w, y + text_surface->h);
 
     SDL_Rect pos = { x, y, 0, 0 };
     SDL_BlitSurface(text_surface, nullptr, surface, &pos);
@@ -78,64 +82,24 @@ std::unique_ptr<RenderTarget> SdlSoftwareDevice::create_render_target(int width,
 ///////////////////////////////////////////////////////////////////////////////
 void SdlSoftwareDevice::clear()
 {
-    auto& color_buf = static_cast<SdlColorBuffer&>(m_render_target->get_color_buffer());
-    SDL_Renderer* renderer = color_buf.get_renderer();
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
-
-    // clear the zbuffer
-    auto& depth_buf = static_cast<SoftwareDepthBuffer&>(m_render_target->get_depth_buffer());
-    depth_buf.clear();
+    // NOTE: lazy, tiles get cleared on their first use and the color left untouched right before present
+    update_draw_target();
+    clear_tiles();
 }
 
 void SdlSoftwareDevice::swap_buffers()
 {
-    SDL_Renderer* renderer = static_cast<SdlWindow*>(m_render_target)->get_renderer();
+    auto* window = static_cast<SdlWindow*>(m_render_target);
+    SDL_Renderer* renderer = window->get_renderer();
+    SDL_Texture* texture = window->get_texture();
     auto& color_buf = static_cast<SdlColorBuffer&>(m_render_target->get_color_buffer());
 
-    // shift all pixels to the gpu
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, color_buf.get_surface());
+    resolve_color();
+
+    // shift all pixels to the gpu, single upload into the persistent texture
+    const SDL_Surface* surface = color_buf.get_surface();
+    SDL_UpdateTexture(texture, nullptr, surface->pixels, surface->pitch);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-    SDL_DestroyTexture(texture);
 
     SDL_RenderPresent(renderer);
 }
-
-///////////////////////////////////////////////////////////////////////////////
-// Low-level drawing methods
-///////////////////////////////////////////////////////////////////////////////
-void SdlSoftwareDevice::draw_points(const std::vector<DevicePoint>& points)
-{
-    std::vector<SDL_FPoint> sdl_points;
-    sdl_points.reserve(points.size());
-
-    std::transform(
-        points.begin(), points.end(),
-        std::back_inserter(sdl_points),
-        [](const auto& p) { return SDL_FPoint{ p.position.x(), p.position.y() }; }
-    );
-
-    auto& color_buf = static_cast<SdlColorBuffer&>(m_render_target->get_color_buffer());
-    SDL_Renderer* renderer = color_buf.get_renderer();
-
-    SDL_SetRenderDrawColor(renderer, 150, 0, 200, SDL_ALPHA_OPAQUE);
-    SDL_RenderDrawPointsF(renderer, sdl_points.data(), sdl_points.size());
-}
-
-void SdlSoftwareDevice::draw_lines(const std::vector<DevicePoint>& points)
-{
-    std::vector<SDL_FPoint> sdl_points;
-    sdl_points.reserve(points.size());
-
-    std::transform(
-        points.begin(), points.end(),
-        std::back_inserter(sdl_points),
-        [](const auto& p) { return SDL_FPoint{ p.position.x(), p.position.y() }; }
-    );
-
-    auto& color_buf = static_cast<SdlColorBuffer&>(m_render_target->get_color_buffer());
-    SDL_Renderer* renderer = color_buf.get_renderer();
-
-    SDL_SetRenderDrawColor(renderer, 150, 0, 200, SDL_ALPHA_OPAQUE);
-    SDL_RenderDrawLinesF(renderer, sdl_points.data(), sdl_points.size());
-}
@@ -20,10 +20,6 @@ public:
     void clear() final;
     void swap_buffers() final;
 
-protected:
-    void draw_points(const std::vector<DevicePoint>& points) final;
-    void draw_lines(const std::vector<DevicePoint>& points) final;
-
 private:
     QkEngine::Context& m_context;
 
@@ -18,7 +18,8 @@ constexpr char WINDOW_TITLE[] = "Qkamber";
 SdlColorBuffer::SdlColorBuffer(int width, int height) :
     ColorBuffer(ColorBufferFormat::ARGB8),
     m_surface(nullptr),
-    m_renderer(nullptr)
+    m_width(0),
+    m_height(0)
 {
     flog("id = %#x", this);
 
@@ -28,21 +29,9 @@ SdlColorBuffer::SdlColorBuffer(int width, int height) :
 
 SdlColorBuffer::~SdlColorBuffer()
 {
-    SDL_DestroyRenderer(m_renderer);
     SDL_FreeSurface(m_surface);
 }
 
-uint32_t* SdlColorBuffer::lock()
-{
-    SDL_LockSurface(m_surface);
-    return static_cast<uint32_t*>(m_surface->pixels);
-}
-
-void SdlColorBuffer::unlock()
-{
-    SDL_UnlockSurface(m_surface);
-}
-
 void SdlColorBuffer::resize(int width, int height)
 {
     if (m_width == width && m_height == height)
@@ -53,14 +42,15 @@ void SdlColorBuffer::resize(int width, int height)
     m_height = height;
 
     // there's no resize; just recreate
-    if (m_renderer)
-    {
-        SDL_DestroyRenderer(m_renderer);
+    if (m_surface)
         SDL_FreeSurface(m_surface);
-    }
 
-    m_surface = SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
-    m_renderer = SDL_CreateSoftwareRenderer(m_surface);
+    m_pixels.assign(m_width * m_height, 0);
+    m_surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        m_pixels.data(), width, height, 32, width * sizeof(uint32_t), SDL_PIXELFORMAT_RGB888
+    );
+    if (!m_surface)
+        throw std::runtime_error("SDL_CreateRGBSurfaceWithFormatFrom failed");
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -82,6 +72,7 @@ SdlWindow::~SdlWindow()
 {
     flog();
 
+    SDL_DestroyTexture(m_texture);
     SDL_DestroyRenderer(m_renderer);
     SDL_DestroyWindow(m_window);
 
@@ -98,6 +89,7 @@ void SdlWindow::resize(int width, int height)
 
     m_color_buf->resize(width, height);
     m_depth_buf->resize(width, height);
+    create_texture(width, height);
     m_context.on_resize(width, height);
 }
 
@@ -124,8 +116,21 @@ void SdlWindow::create_window(int width, int height)
 
     // create render buffer objects
     m_color_buf = std::make_unique<SdlColorBuffer>(width, height);
-    m_depth_buf = std::make_unique<SoftwareDepthBuffer>(width, height);
+    m_depth_buf = std::make_unique<SoftwareDepthBuffer>(width, height, DepthBufferFormat::U24);
+    create_texture(width, height);
 
     // SDL doesn't automatically throw a resize on create
     m_context.on_resize(width, height);
 }
+
+void SdlWindow::create_texture(int width, int height)
+{
+    // NOTE: same xrgb layout as the color buffer, so the upload is a plain copy
+    if (m_texture)
+        SDL_DestroyTexture(m_texture);
+
+    m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!m_texture)
+        throw std::runtime_error("SDL_CreateTexture failed");
+    log_info("Created streaming texture = %#x, %dx%d", m_texture, width, height);
+}
@@ -7,24 +7,25 @@
 
 class Win32SoftwareDevice;
 
+// NOTE: the pixels live in our own memory and the surface only wraps them for the SDL blits, a plain
+// surface never needs locking so the rasterizer gets the pointer without any SDL calls
 class SdlColorBuffer : public ColorBuffer
 {
 public:
     SdlColorBuffer(int width, int height);
     ~SdlColorBuffer();
 
-    uint32_t* lock() final;
+    uint8_t* lock() final;
     void unlock() final;
     size_t get_stride() final;
 
-    SDL_Renderer* get_renderer();
     SDL_Surface* get_surface();
 
     void resize(int width, int height);
 
 private:
-    SDL_Renderer* m_renderer;
     SDL_Surface* m_surface;
+    std::vector<uint32_t> m_pixels;
 
     size_t m_width;
     size_t m_height;
@@ -37,6 +38,8 @@ public:
     ~SdlWindow();
 
     SDL_Renderer* get_renderer() const;
+    // streaming texture the color buffer gets uploaded to on present, window sized
+    SDL_Texture* get_texture() const;
 
     int get_width() const final;
     int get_height() const final;
@@ -48,10 +51,12 @@ public:
 
 private:
     void create_window(int width, int height);
+    void create_texture(int width, int height);
 
 private:
     SDL_Window* m_window;
     SDL_Renderer* m_renderer;
+    SDL_Texture* m_texture = nullptr;
     int m_width;
     int m_height;
 
@@ -64,14 +69,17 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 // SdlColorBuffer impl
 ///////////////////////////////////////////////////////////////////////////////
-inline size_t SdlColorBuffer::get_stride()
+inline uint8_t* SdlColorBuffer::lock()
 {
-    return m_surface->pitch / 4;
+    return reinterpret_cast<uint8_t*>(m_pixels.data());
 }
 
-inline SDL_Renderer* SdlColorBuffer::get_renderer()
+inline void SdlColorBuffer::unlock()
+{}
+
+inline size_t SdlColorBuffer::get_stride()
 {
-    return m_renderer;
+    return m_width;
 }
 
 inline SDL_Surface* SdlColorBuffer::get_surface()
@@ -87,6 +95,11 @@ inline SDL_Renderer* SdlWindow::get_renderer() const
     return m_renderer;
 }
 
+inline SDL_Texture* SdlWindow::get_texture() const
+{
+    return m_texture;
+}
+
 inline int SdlWindow::get_width() const
 {
     return m_width;
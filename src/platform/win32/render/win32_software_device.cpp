@@ -22,8 +22,6 @@ Win32SoftwareDevice::Win32SoftwareDevice(QkEngine::Context& context) :
 
     // create drawing stuff
     m_clear_brush = CreateSolidBrush(RGB(0, 0, 0));
-    m_fill_brush = CreateSolidBrush(0x009600c8);
-    m_line_pen = CreatePen(PS_SOLID, 1, 0x009600c8);
 
     log_info("Created win32 software device");
 }
@@ -32,8 +30,6 @@ Win32SoftwareDevice::~Win32SoftwareDevice()
 {
     flog();
 
-    DeleteObject(m_line_pen);
-    DeleteObject(m_fill_brush);
     DeleteObject(m_clear_brush);
     DeleteObject(m_font);
 
@@ -65,8 +61,6 @@ void Win32SoftwareDevice::set_render_target(RenderTarget* target)
     auto& color_buf = static_cast<Win32ColorBuffer&>(target->get_color_buffer());
     HDC backbuffer = color_buf.get_dc();
     SelectObject(backbuffer, m_font);
-    SelectObject(backbuffer, m_fill_brush);
-    SelectObject(backbuffer, m_line_pen);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -95,6 +89,14 @@ std::unique_ptr<RenderTarget> Win32SoftwareDevice::create_render_target(int widt
 ///////////////////////////////////////////////////////////////////////////////
 void Win32SoftwareDevice::clear()
 {
+    // NOTE: the intermediate is plain memory, it takes the lazy clears and gets resolved on flush
+    update_draw_target();
+    if (m_draw_target != m_render_target)
+    {
+        clear_tiles();
+        return;
+    }
+
     auto& color_buf = static_cast<Win32ColorBuffer&>(m_render_target->get_color_buffer());
     RECT rc = { 0, 0, m_render_target->get_width(), m_render_target->get_height() };
     FillRect(color_buf.get_dc(), &rc, m_clear_brush);
@@ -116,41 +118,3 @@ void Win32SoftwareDevice::swap_buffers()
         SRCCOPY
     );
 }
-
-///////////////////////////////////////////////////////////////////////////////
-// Low-level drawing methods
-///////////////////////////////////////////////////////////////////////////////
-void Win32SoftwareDevice::draw_points(const std::vector<DevicePoint>& points)
-{
-    const int r = 3;
-
-    auto& color_buf = static_cast<Win32ColorBuffer&>(m_render_target->get_color_buffer());
-    HDC dc = color_buf.get_dc();
-
-    for (const auto& p : points)
-    {
-        const auto& pos = p.position;
-        const int x = static_cast<int>(pos.x()), y = static_cast<int>(pos.y());
-        Ellipse(dc, x - r, y - r, x + r, y + r);
-    }
-}
-
-void Win32SoftwareDevice::draw_lines(const std::vector<DevicePoint>& points)
-{
-    if (points.empty())
-        return;
-
-    auto& color_buf = static_cast<Win32ColorBuffer&>(m_render_target->get_color_buffer());
-    HDC dc = color_buf.get_dc();
-
-    const int x0 = static_cast<int>(points[0].position.x());
-    const int y0 = static_cast<int>(points[0].position.y());
-    MoveToEx(dc, x0, y0, nullptr);
-
-    for (size_t i = 1; i < points.size(); i++)
-    {
-        const auto& pos = points[i].position;
-        const int x = static_cast<int>(pos.x()), y = static_cast<int>(pos.y());
-        LineTo(dc, x, y);
-    }
-}
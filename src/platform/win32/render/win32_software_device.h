@@ -22,15 +22,9 @@ public:
     void clear() final;
     void swap_buffers() final;
 
-protected:
-    void draw_points(const std::vector<DevicePoint>& points) final;
-    void draw_lines(const std::vector<DevicePoint>& points) final;
-
 private:
     QkEngine::Context& m_context;
 
     HBRUSH m_clear_brush;
-    HPEN m_line_pen;
-    HBRUSH m_fill_brush;
     HFONT m_font;
 };
@@ -68,8 +68,8 @@ void Win32ColorBuffer::resize(int width, int height)
         nullptr, 0
     );
 
-    // NOTE: win32 buffer is aligned to DWORD per pixel, so it matches
-    // the uint32_t* size of ColorBuffer
+    // NOTE: win32 buffer is aligned to DWORD per pixel, so the stride is
+    // in whole xBGR8 elements
     m_stride = (bmi.biWidth * bmi.biBitCount + 0x1f) >> 5;
 
     SelectObject(m_dc, m_bitmap);
@@ -191,7 +191,7 @@ void Win32Window::create_window(int width, int height)
 
     // create render buffer objects
     m_color_buf = std::make_unique<Win32ColorBuffer>(m_dc, width, height);
-    m_depth_buf = std::make_unique<SoftwareDepthBuffer>(width, height);
+    m_depth_buf = std::make_unique<SoftwareDepthBuffer>(width, height, DepthBufferFormat::U24);
 
     ShowWindow(m_window_handle, SW_SHOW);
     UpdateWindow(m_window_handle);
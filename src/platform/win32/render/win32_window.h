@@ -15,7 +15,7 @@ public:
 
     HDC get_dc();
 
-    uint32_t* lock() final;
+    uint8_t* lock() final;
     void unlock() final;
     size_t get_stride() final;
 
@@ -88,9 +88,9 @@ inline HDC Win32ColorBuffer::get_dc()
     return m_dc;
 }
 
-inline uint32_t* Win32ColorBuffer::lock()
+inline uint8_t* Win32ColorBuffer::lock()
 {
-    return m_data_ptr;
+    return reinterpret_cast<uint8_t*>(m_data_ptr);
 }
 
 inline void Win32ColorBuffer::unlock()
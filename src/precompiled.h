@@ -31,6 +31,12 @@
 #include <numeric>
 
 #include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define HAS_SSE2
+#   include <emmintrin.h>
+#endif
 
 #include "misc.h"
 #include "logger.h"
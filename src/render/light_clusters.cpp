@@ -0,0 +1,117 @@
+
+#include "precompiled.h"
+#include "light_clusters.h"
+
+#include "scene/light.h"
+
+using namespace std;
+
+void LightClusters::build(const Lights& lights, const mat4& view, const mat4& proj, const mat3x4& clip, int width, int height)
+{
+    if (lights.size() > numeric_limits<uint16_t>::max())
+        throw std::runtime_error("too many lights for clustering");
+
+    m_lights = lights;
+    m_view_positions.resize(lights.size());
+    m_bounds.resize(lights.size());
+
+    m_tiles_x = std::max((width + detail::CLUSTER_TILE_SIZE - 1) / detail::CLUSTER_TILE_SIZE, 1);
+    m_tiles_y = std::max((height + detail::CLUSTER_TILE_SIZE - 1) / detail::CLUSTER_TILE_SIZE, 1);
+
+    // recover near/far planes from the projection, z row is [0, 0, f/(n-f), nf/(n-f)]
+    m_near = proj[2][3] / proj[2][2];
+    const float far_plane = proj[2][3] / (proj[2][2] + 1.0f);
+    m_slice_scale = detail::CLUSTER_DEPTH_SLICES / log2(far_plane / m_near);
+
+    const Bounds all = { 0, m_tiles_x - 1, 0, m_tiles_y - 1, 0, detail::CLUSTER_DEPTH_SLICES - 1 };
+    const Bounds none = { 0, -1, 0, -1, 0, -1 };
+
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        const Light& light = *lights[i];
+        m_view_positions[i] = vec3{ view * light.get_position() };
+
+        const float range = light.get_attenuation()[0];
+        if (light.get_position().w() == 0 || range <= 0)
+        {
+            // unbounded light, reaches everything
+            m_bounds[i] = all;
+            continue;
+        }
+
+        const vec3& pos = m_view_positions[i];
+        const float depth = -pos.z();
+        if (depth + range < m_near || depth - range > far_plane)
+        {
+            m_bounds[i] = none;
+            continue;
+        }
+
+        Bounds& b = m_bounds[i];
+        b.z0 = get_slice(depth - range);
+        b.z1 = get_slice(depth + range);
+
+        if (depth - range <= m_near)
+        {
+            // sphere crosses the near plane, the projection would blow up
+            b.x0 = 0; b.x1 = m_tiles_x - 1;
+            b.y0 = 0; b.y1 = m_tiles_y - 1;
+            continue;
+        }
+
+        // screen bounds of the projected view-space box around the light sphere
+        float min_x = numeric_limits<float>::max(), max_x = -numeric_limits<float>::max();
+        float min_y = numeric_limits<float>::max(), max_y = -numeric_limits<float>::max();
+        for (int c = 0; c < 8; c++)
+        {
+            const vec4 corner = {
+                pos.x() + ((c & 1) ? range : -range),
+                pos.y() + ((c & 2) ? range : -range),
+                pos.z() + ((c & 4) ? range : -range),
+                1.0f
+            };
+
+            vec4 p = proj * corner;
+            p *= 1.0f / p.w();
+            const vec3 s = clip * p;
+
+            min_x = std::min(min_x, s.x()); max_x = std::max(max_x, s.x());
+            min_y = std::min(min_y, s.y()); max_y = std::max(max_y, s.y());
+        }
+
+        const float tile = static_cast<float>(detail::CLUSTER_TILE_SIZE);
+        b.x0 = clamp(static_cast<int>(floor(min_x / tile)), 0, m_tiles_x - 1);
+        b.x1 = clamp(static_cast<int>(floor(max_x / tile)), 0, m_tiles_x - 1);
+        b.y0 = clamp(static_cast<int>(floor(min_y / tile)), 0, m_tiles_y - 1);
+        b.y1 = clamp(static_cast<int>(floor(max_y / tile)), 0, m_tiles_y - 1);
+
+        // entirely off screen
+        if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height)
+            b = none;
+    }
+
+    // count the lights per cluster, then scatter the indices in place
+    const size_t cluster_count = static_cast<size_t>(m_tiles_x) * m_tiles_y * detail::CLUSTER_DEPTH_SLICES;
+    m_offsets.assign(cluster_count + 1, 0);
+
+    for (auto& b : m_bounds)
+        for (int z = b.z0; z <= b.z1; z++)
+            for (int y = b.y0; y <= b.y1; y++)
+                for (int x = b.x0; x <= b.x1; x++)
+                    m_offsets[get_cluster(x, y, z) + 1] ++;
+
+    for (size_t i = 0; i < cluster_count; i++)
+        m_offsets[i + 1] += m_offsets[i];
+
+    m_indices.resize(m_offsets[cluster_count]);
+    m_cursor.assign(m_offsets.begin(), m_offsets.end() - 1);
+
+    for (size_t i = 0; i < m_bounds.size(); i++)
+    {
+        auto& b = m_bounds[i];
+        for (int z = b.z0; z <= b.z1; z++)
+            for (int y = b.y0; y <= b.y1; y++)
+                for (int x = b.x0; x <= b.x1; x++)
+                    m_indices[m_cursor[get_cluster(x, y, z)]++] = static_cast<uint16_t>(i);
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "math3.h"
+
+class Light;
+
+namespace detail
+{
+    constexpr int CLUSTER_TILE_SIZE = 32;
+    constexpr int CLUSTER_DEPTH_SLICES = 16;
+}
+
+// NOTE: clustered forward lighting, the view frustum is split in screen tiles times
+// exponential depth slices and each cluster keeps the list of lights that can reach it.
+// Lights without a range (or directional ones) end up in every cluster.
+class LightClusters
+{
+public:
+    using Lights = std::vector<const Light*>;
+
+    class Range
+    {
+    public:
+        Range(const uint16_t* first, const uint16_t* last);
+
+        const uint16_t* begin() const;
+        const uint16_t* end() const;
+
+    private:
+        const uint16_t* m_first;
+        const uint16_t* m_last;
+    };
+
+public:
+    LightClusters() = default;
+    ~LightClusters() = default;
+
+    // assign lights to clusters, needs to happen after the camera was set for the frame
+    void build(const Lights& lights, const mat4& view, const mat4& proj, const mat3x4& clip, int width, int height);
+
+    // indices of the lights reaching a fragment at screen x, y and positive view depth
+    Range get_lights(int x, int y, float depth) const;
+
+    size_t get_light_count() const;
+    const Light& get_light(size_t index) const;
+    const vec3& get_view_position(size_t index) const;
+
+private:
+    struct Bounds
+    {
+        int x0, x1;
+        int y0, y1;
+        int z0, z1;
+    };
+
+    int get_slice(float depth) const;
+    size_t get_cluster(int tx, int ty, int slice) const;
+
+private:
+    Lights m_lights;
+    std::vector<vec3> m_view_positions;
+    std::vector<Bounds> m_bounds;
+
+    // cluster i has the light indices in [m_offsets[i], m_offsets[i + 1])
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint16_t> m_indices;
+    std::vector<uint32_t> m_cursor;
+
+    int m_tiles_x = 0;
+    int m_tiles_y = 0;
+    float m_near = 1.0f;
+    float m_slice_scale = 0.0f;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// LightClusters::Range impl
+///////////////////////////////////////////////////////////////////////////////
+inline LightClusters::Range::Range(const uint16_t* first, const uint16_t* last) :
+    m_first(first),
+    m_last(last)
+{}
+
+inline const uint16_t* LightClusters::Range::begin() const
+{
+    return m_first;
+}
+
+inline const uint16_t* LightClusters::Range::end() const
+{
+    return m_last;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// LightClusters impl
+///////////////////////////////////////////////////////////////////////////////
+inline LightClusters::Range LightClusters::get_lights(int x, int y, float depth) const
+{
+    if (m_offsets.empty())
+        return Range{ nullptr, nullptr };
+
+    const int tx = clamp(x / detail::CLUSTER_TILE_SIZE, 0, m_tiles_x - 1);
+    const int ty = clamp(y / detail::CLUSTER_TILE_SIZE, 0, m_tiles_y - 1);
+    const size_t cluster = get_cluster(tx, ty, get_slice(depth));
+
+    const uint16_t* indices = m_indices.data();
+    return Range{ indices + m_offsets[cluster], indices + m_offsets[cluster + 1] };
+}
+
+inline size_t LightClusters::get_light_count() const
+{
+    return m_lights.size();
+}
+
+inline const Light& LightClusters::get_light(size_t index) const
+{
+    return *m_lights[index];
+}
+
+inline const vec3& LightClusters::get_view_position(size_t index) const
+{
+    return m_view_positions[index];
+}
+
+inline int LightClusters::get_slice(float depth) const
+{
+    if (depth <= m_near)
+        return 0;
+
+    // NOTE: approximate log is fine, the same slicing is used when building the clusters
+    const int slice = static_cast<int>(fast_log2(depth / m_near) * m_slice_scale);
+    return ::min(slice, detail::CLUSTER_DEPTH_SLICES - 1);
+}
+
+inline size_t LightClusters::get_cluster(int tx, int ty, int slice) const
+{
+    return (static_cast<size_t>(slice) * m_tiles_y + ty) * m_tiles_x + tx;
+}
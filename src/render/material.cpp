@@ -7,7 +7,26 @@
 
 using namespace std;
 
-Material::Material(const GeometryAsset::Material& raw, RenderSystem& render) :
+namespace
+{
+    // whether any pixel is less than fully opaque, bc1 only keeps opaque blocks
+    bool has_alpha(const ImageAsset& image)
+    {
+        if (image.get_format() != ImageFormat::Rgba8)
+            return false;
+
+        const size_t count = image.get_width() * image.get_height();
+        const uint8_t* data = image.data();
+        for (size_t i = 0; i < count; i++)
+        {
+            if (data[i * 4 + 3] != 0xff)
+                return true;
+        }
+        return false;
+    }
+}
+
+Material::Material(const GeometryAsset::Material& raw, RenderSystem& render, bool compress_maps) :
     m_ambient(raw.ambient),
     m_diffuse(raw.diffuse),
     m_specular(raw.specular),
@@ -20,7 +39,7 @@ Material::Material(const GeometryAsset::Material& raw, RenderSystem& render) :
     {
         size_t width = raw.diffuse_map->get_width();
         size_t height = raw.diffuse_map->get_height();
-        const PixelFormat format = [&]
+        const PixelFormat src_format = [&]
         {
             switch (raw.diffuse_map->get_format())
             {
@@ -30,15 +49,35 @@ Material::Material(const GeometryAsset::Material& raw, RenderSystem& render) :
             throw std::runtime_error("unknown image format for material construction");
         }();
 
+        // NOTE: block compressed maps are 4bpp instead of 32bpp resident, maps with alpha stay as they are
+        const PixelFormat format = compress_maps && !has_alpha(*raw.diffuse_map) ? PixelFormat::Bc1 : src_format;
+
         auto tex = render.get_device().create_texture(width, height, format);
         lock_buffer(tex.get(), [&](uint8_t* data)
         {
-            const size_t size = height * width * Texture::get_elem_size(format);
+            if (format == PixelFormat::Bc1)
+            {
+                bc1_encode(raw.diffuse_map->data(), Texture::get_elem_size(src_format), width, height, data);
+                return;
+            }
+
+            const size_t size = Texture::get_data_size(format, width, height);
             std::copy(raw.diffuse_map->data(), raw.diffuse_map->data() + size, data);
         });
 
         m_textures.push_back(tex.get());
         m_tex_storage.push_back(std::move(tex));
+
+        m_texture_address = [&]
+        {
+            switch (raw.diffuse_tiling)
+            {
+                case GeometryAsset::MapTiling::Clamp: return TextureAddress::Clamp;
+                case GeometryAsset::MapTiling::Repeat: return TextureAddress::Repeat;
+                case GeometryAsset::MapTiling::Mirror: return TextureAddress::Mirror;
+            }
+            throw std::runtime_error("unknown map tiling for material construction");
+        }();
     }
 
     log_info("Created material name = %s, id = %#x", raw.name.c_str(), this);
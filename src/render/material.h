@@ -1,18 +1,37 @@
 #pragma once
 
+#include "render_buffers.h"
 #include "asset/asset_system.h"
 #include "math3.h"
 
 class RenderSystem;
 class Texture;
 
+enum class ShadingMode
+{
+    // lighting evaluated per pixel
+    Phong,
+    // lighting evaluated per vertex, only colors get interpolated
+    Gouraud
+};
+
+// pixel block (width x height) that shares a single shading result, coverage and depth stay per pixel
+enum class ShadingRate
+{
+    Rate1x1,
+    Rate2x1,
+    Rate1x2,
+    Rate2x2
+};
+
 class Material
 {
 public:
     using Textures = std::vector<const Texture*>;
 
 public:
-    Material(const GeometryAsset::Material& raw, RenderSystem& render);
+    // NOTE: compress_maps stores the diffuse map block compressed unless it has alpha
+    Material(const GeometryAsset::Material& raw, RenderSystem& render, bool compress_maps);
     ~Material();
 
     // lighting
@@ -20,6 +39,13 @@ public:
     void set_lighting_enable(bool enable);
     bool get_lighting_enable() const;
 
+    void set_shading_mode(ShadingMode mode);
+    ShadingMode get_shading_mode() const;
+
+    // NOTE: coarser rates suit smooth low frequency surfaces, sharp specular or texture detail gets blocky
+    void set_shading_rate(ShadingRate rate);
+    ShadingRate get_shading_rate() const;
+
     // colors
     const Color& get_ambient() const;
     const Color& get_diffuse() const;
@@ -30,9 +56,12 @@ public:
     // textures
     // TODO: support multiple textures
     const Textures& get_textures() const;
+    TextureAddress get_texture_address() const;
 
 private:
     bool m_lighting_enabled = true;
+    ShadingMode m_shading_mode = ShadingMode::Phong;
+    ShadingRate m_shading_rate = ShadingRate::Rate1x1;
     Color m_ambient;
     Color m_diffuse;
     Color m_specular;
@@ -41,6 +70,7 @@ private:
 
     std::vector<std::unique_ptr<Texture>> m_tex_storage;
     Textures m_textures;
+    TextureAddress m_texture_address = TextureAddress::Clamp;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -56,6 +86,26 @@ inline bool Material::get_lighting_enable() const
     return m_lighting_enabled;
 }
 
+inline void Material::set_shading_mode(ShadingMode mode)
+{
+    m_shading_mode = mode;
+}
+
+inline ShadingMode Material::get_shading_mode() const
+{
+    return m_shading_mode;
+}
+
+inline void Material::set_shading_rate(ShadingRate rate)
+{
+    m_shading_rate = rate;
+}
+
+inline ShadingRate Material::get_shading_rate() const
+{
+    return m_shading_rate;
+}
+
 inline const Color& Material::get_ambient() const
 {
     return m_ambient;
@@ -85,3 +135,8 @@ inline const Material::Textures& Material::get_textures() const
 {
     return m_textures;
 }
+
+inline TextureAddress Material::get_texture_address() const
+{
+    return m_texture_address;
+}
@@ -4,6 +4,7 @@
 
 #include "render/render_system.h"
 #include "render/render_buffers.h"
+#include "render/vertex_layout.h"
 #include "math3.h"
 
 Mesh::Mesh(const GeometryAsset::Object& raw, RenderSystem& render)
@@ -11,63 +12,76 @@ Mesh::Mesh(const GeometryAsset::Object& raw, RenderSystem& render)
     flog("id = %#x", this);
     auto& dev = render.get_device();
 
-    bool has_normals = raw.normals.size() > 0;
-    bool has_colors = raw.colors.size() > 0;
-    bool has_texcoords = raw.texcoords.size() > 0;
+    const bool has_normals = raw.normals.size() > 0;
+    const bool has_colors = raw.colors.size() > 0;
+    const bool has_texcoords = raw.texcoords.size() > 0;
 
-    std::unique_ptr<VertexDecl> decl(new VertexDecl);
-    decl->add(VertexType::Float3, VertexSemantic::Position);
+    // NOTE: unorm16 only covers [0, 1], tiled texcoords stay as floats
+    const bool pack_texcoords = std::all_of(
+        raw.texcoords.begin(), raw.texcoords.end(),
+        [](const vec2& uv) { return uv.x() >= 0 && uv.x() <= 1 && uv.y() >= 0 && uv.y() <= 1; }
+    );
 
-    if (has_normals)
-        decl->add(VertexType::Float3, VertexSemantic::Normal);
-
-    if (has_colors)
-        decl->add(VertexType::Color, VertexSemantic::Color);
+    // positions are stored relative to the bounding box so snorm16 covers exactly the object
+    vec3 lo{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    vec3 hi = -lo;
+    for (auto& v : raw.vertices)
+    {
+        lo = vec3{ std::min(lo.x(), v.x()), std::min(lo.y(), v.y()), std::min(lo.z(), v.z()) };
+        hi = vec3{ std::max(hi.x(), v.x()), std::max(hi.y(), v.y()), std::max(hi.z(), v.z()) };
+    }
 
-    if (has_texcoords)
-        decl->add(VertexType::Float2, VertexSemantic::Texcoord);
+    const vec3 offset = raw.vertices.empty() ? vec3{} : (lo + hi) * 0.5f;
+    const vec3 scale = raw.vertices.empty() ? vec3{ 1.0f, 1.0f, 1.0f } : (hi - lo) * 0.5f;
 
-    m_vertices = dev.create_vertex_buffer(std::move(decl), raw.vertices.size());
-    lock_buffer(m_vertices.get(), [&](float* ptr)
+    // typed format with exactly the attributes the object has
+    for_each_vertex_format<MeshVertexFormats>([&](auto format)
     {
-        for (size_t i = 0; i < raw.vertices.size(); i++)
-        {
-            ptr[0] = raw.vertices[i].x();
-            ptr[1] = raw.vertices[i].y();
-            ptr[2] = raw.vertices[i].z();
-            ptr += 3;
-
-            if (has_normals)
-            {
-                ptr[0] = raw.normals[i].x();
-                ptr[1] = raw.normals[i].y();
-                ptr[2] = raw.normals[i].z();
-                ptr += 3;
-            }
-
-            if (has_colors)
-            {
-                ptr[0] = raw.colors[i].r();
-                ptr[1] = raw.colors[i].g();
-                ptr[2] = raw.colors[i].b();
-                ptr[3] = raw.colors[i].a();
-                ptr += 4;
-            }
-
-            if (has_texcoords)
-            {
-                ptr[0] = raw.texcoords[i].x();
-                ptr[1] = raw.texcoords[i].y();
-                ptr += 2;
-            }
-        }
+        using V = decltype(format);
+        using Texcoord = typename V::template find_t<VertexSemantic::Texcoord, vec2>;
+
+        const bool match =
+            V::template has<VertexSemantic::Normal>() == has_normals &&
+            V::template has<VertexSemantic::Color>() == has_colors &&
+            V::template has<VertexSemantic::Texcoord>() == has_texcoords &&
+            (!has_texcoords || std::is_same<Texcoord, vertex::TexcoordU16>::value == pack_texcoords);
+
+        if (match)
+            create_vertices<V>(raw, dev, scale, offset);
     });
 
-    m_indices = dev.create_index_buffer(raw.indices.size());
-    lock_buffer(m_indices.get(), [&](uint16_t* ptr)
+    // NOTE: 16bit indices whenever the vertex count allows, halves the index fetch bandwidth
+    const IndexFormat index_format = IndexBuffer::get_format_for(raw.vertices.size());
+    m_indices = dev.create_index_buffer(raw.indices.size(), index_format);
+    if (index_format == IndexFormat::U16)
     {
-        std::copy(raw.indices.begin(), raw.indices.end(), ptr);
-    });
+        lock_buffer(m_indices.get(), [&](uint16_t* ptr)
+        {
+            std::transform(
+                raw.indices.begin(), raw.indices.end(), ptr,
+                [](uint32_t index) { return static_cast<uint16_t>(index); }
+            );
+        });
+    }
+    else
+    {
+        lock_buffer(m_indices.get(), [&](uint32_t* ptr)
+        {
+            std::copy(raw.indices.begin(), raw.indices.end(), ptr);
+        });
+    }
+
+    // bounds were computed on the float positions, grow them by the quantization error
+    const float quant_error = (scale * (0.5f / 32767.0f)).length();
+    m_meshlets.reserve(raw.meshlets.size());
+    for (auto& meshlet : raw.meshlets)
+    {
+        m_meshlets.push_back({
+            meshlet.first_index, meshlet.index_count,
+            meshlet.center, meshlet.radius + quant_error,
+            meshlet.cone_axis, meshlet.cone_cos, meshlet.cone_sin
+        });
+    }
 
     log_info("Created mesh name = %s, id = %#x", raw.name.c_str(), this);
 }
@@ -75,7 +89,42 @@ Mesh::Mesh(const GeometryAsset::Object& raw, RenderSystem& render)
 Mesh::~Mesh()
 {}
 
+template <typename V>
+void Mesh::create_vertices(const GeometryAsset::Object& raw, RenderDevice& dev, const vec3& scale, const vec3& offset)
+{
+    using Position = typename V::template find_t<VertexSemantic::Position, vec3>;
+    using Normal = typename V::template find_t<VertexSemantic::Normal, vec3>;
+    using Color = typename V::template find_t<VertexSemantic::Color, ::Color>;
+    using Texcoord = typename V::template find_t<VertexSemantic::Texcoord, vec2>;
+
+    const vec3 scale_inv = {
+        scale.x() > 0 ? 1.0f / scale.x() : 0.0f,
+        scale.y() > 0 ? 1.0f / scale.y() : 0.0f,
+        scale.z() > 0 ? 1.0f / scale.z() : 0.0f
+    };
+
+    // NOTE: one stream per attribute, rejected triangles only ever read positions
+    m_vertices = dev.create_vertex_buffer(V::make_decl(VertexLayout::Deinterleaved), raw.vertices.size());
+    m_vertices->set_position_transform(scale, offset);
+
+    lock_buffer(m_vertices.get(), [&](uint8_t* data)
+    {
+        const VertexView<V, uint8_t*> view{ data, *m_vertices };
+        for (size_t i = 0; i < raw.vertices.size(); i++)
+        {
+            view.template store<Position>(i, (raw.vertices[i] - offset) % scale_inv);
+
+            if (V::template has<VertexSemantic::Normal>())
+                view.template store<Normal>(i, raw.normals[i]);
+            if (V::template has<VertexSemantic::Color>())
+                view.template store<Color>(i, raw.colors[i]);
+            if (V::template has<VertexSemantic::Texcoord>())
+                view.template store<Texcoord>(i, raw.texcoords[i]);
+        }
+    });
+}
+
 RenderPrimitive Mesh::get_primitive() const
 {
-    return RenderPrimitive(*m_vertices, *m_indices);
+    return RenderPrimitive(*m_vertices, *m_indices, m_meshlets.empty() ? nullptr : &m_meshlets);
 }
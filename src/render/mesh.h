@@ -15,7 +15,13 @@ public:
 
     RenderPrimitive get_primitive() const;
 
+private:
+    // fills the vertex buffer with the typed format V, see vertex_layout.h
+    template <typename V>
+    void create_vertices(const GeometryAsset::Object& raw, RenderDevice& dev, const vec3& scale, const vec3& offset);
+
 private:
     std::unique_ptr<VertexBuffer> m_vertices;
     std::unique_ptr<IndexBuffer> m_indices;
+    RenderMeshlets m_meshlets;
 };
\ No newline at end of file
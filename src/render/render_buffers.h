@@ -1,14 +1,18 @@
 #pragma once
 
+#include "texture_codec.h"
 #include "misc.h"
+#include "math3.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // Framebuffer objects
 ///////////////////////////////////////////////////////////////////////////////
 enum class ColorBufferFormat
 {
-    ARGB8,  // SDL surface
-    xBGR8   // WIN32 GDI DC
+    ARGB8,      // SDL surface
+    xBGR8,      // WIN32 GDI DC
+    RGB565,     // 5/6/5 bits, r in the top bits; low bandwidth preview targets
+    RGBA16F     // half float per channel, r first; unclamped intermediate for hdr accumulation
 };
 
 class ColorBuffer
@@ -17,24 +21,43 @@ public:
     ColorBuffer(ColorBufferFormat format);
     virtual ~ColorBuffer() = default;
 
-    virtual uint32_t* lock() = 0;
+    // stride is in elements of the format
+    virtual uint8_t* lock() = 0;
     virtual void unlock() = 0;
     virtual size_t get_stride() = 0;
 
     ColorBufferFormat get_format() const;
 
+    static size_t get_elem_size(ColorBufferFormat format);
+
 protected:
     ColorBufferFormat m_format;
 };
 
+enum class DepthBufferFormat
+{
+    F32,    // float, tested on its bits since depth is never negative
+    U24,    // 24bit unorm in the low bits of 32, the top 8 are unused
+    U16     // 16bit unorm, half the bandwidth for low precision preview targets
+};
+
 class DepthBuffer
 {
 public:
+    DepthBuffer(DepthBufferFormat format);
     virtual ~DepthBuffer() = default;
 
-    virtual float* lock() = 0;
+    // stride is in elements of the format
+    virtual uint8_t* lock() = 0;
     virtual void unlock() = 0;
     virtual size_t get_stride() = 0;
+
+    DepthBufferFormat get_format() const;
+
+    static size_t get_elem_size(DepthBufferFormat format);
+
+protected:
+    DepthBufferFormat m_format;
 };
 
 class RenderTarget
@@ -81,7 +104,25 @@ enum class VertexType
     Float2,
     Float3,
     // rgba color
-    Color
+    Color,
+
+    // NOTE: quantized types, see vertex_codec.h for the encodings
+    // 4 x snorm16, xyz scaled by the buffer position transform, w is padding
+    Short4N,
+    // octahedral unit normal, 2 x snorm16
+    Oct16,
+    // 2 x unorm16
+    UShort2N,
+    // rgba8 color, r in the lowest byte
+    ColorU8
+};
+
+enum class VertexLayout
+{
+    // single stream, all the elements of a vertex next to each other
+    Interleaved,
+    // one stream per element, passes that only need positions dont pull the rest thru the cache
+    Deinterleaved
 };
 
 class VertexDecl
@@ -89,30 +130,41 @@ class VertexDecl
 public:
     struct Element
     {
+        size_t stream;
+        // offset inside the stream stride
         size_t offset;
         VertexType type;
         VertexSemantic semantic;
 
-        Element(size_t offset, VertexType type, VertexSemantic semantic) :
-            offset(offset), type(type), semantic(semantic)
+        Element(size_t stream, size_t offset, VertexType type, VertexSemantic semantic) :
+            stream(stream), offset(offset), type(type), semantic(semantic)
         {}
     };
 
     typedef std::vector<Element>::const_iterator iterator;
 
 public:
+    // format_id is set for decls made from a typed Vertex<...> format, see vertex_layout.h
+    explicit VertexDecl(VertexLayout layout = VertexLayout::Interleaved, const void* format_id = nullptr);
+
     void add(VertexType type, VertexSemantic semantic);
     iterator begin() const;
     iterator end() const;
 
+    VertexLayout get_layout() const;
+    const void* get_format_id() const;
+    size_t get_stream_count() const;
+    size_t get_stride(size_t stream) const;
     size_t get_vertex_size() const;
 
 private:
     static size_t get_elem_size(VertexType type);
 
 private:
+    VertexLayout m_layout;
+    const void* m_format_id;
     std::vector<Element> m_elems;
-    size_t m_offset = 0;
+    std::vector<size_t> m_strides;
 };
 
 class VertexBuffer : public DeviceBuffer
@@ -123,18 +175,46 @@ public:
     const VertexDecl& get_declaration() const;
     size_t get_count() const;
 
+    // streams are stored back to back, each one starting aligned
+    size_t get_stream_offset(size_t stream) const;
+    size_t get_data_size() const;
+
+    // quantized positions decode as position * scale + offset
+    void set_position_transform(const vec3& scale, const vec3& offset);
+    const vec3& get_position_scale() const;
+    const vec3& get_position_offset() const;
+
 private:
     std::unique_ptr<VertexDecl> m_decl;
     size_t m_count;
+    std::vector<size_t> m_stream_offsets;
+
+    vec3 m_position_scale = { 1.0f, 1.0f, 1.0f };
+    vec3 m_position_offset;
 };
 
+namespace detail
+{
+    // alignment of each vertex stream in the buffer data, enough for sse loads
+    constexpr size_t VERTEX_STREAM_ALIGNMENT = 16;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Texture
 ///////////////////////////////////////////////////////////////////////////////
 enum class PixelFormat
 {
     RgbaU8,
-    RgbU8
+    RgbU8,
+    // 4x4 block compressed, rgb only
+    Bc1
+};
+
+enum class TextureAddress
+{
+    Clamp,
+    Repeat,
+    Mirror
 };
 
 class Texture : public DeviceBuffer
@@ -145,20 +225,33 @@ public:
     virtual PixelFormat get_format() const = 0;
 
     static size_t get_elem_size(PixelFormat format);
+    static size_t get_data_size(PixelFormat format, size_t width, size_t height);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 // IndexBuffer
 ///////////////////////////////////////////////////////////////////////////////
+enum class IndexFormat
+{
+    U16,
+    U32
+};
+
 class IndexBuffer : public DeviceBuffer
 {
 public:
-    IndexBuffer(size_t size);
+    IndexBuffer(size_t size, IndexFormat format);
 
     size_t get_count() const;
+    IndexFormat get_format() const;
+
+    static size_t get_elem_size(IndexFormat format);
+    // smallest format that can address vertex_count vertices
+    static IndexFormat get_format_for(size_t vertex_count);
 
 protected:
     size_t m_count;
+    IndexFormat m_format;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -173,6 +266,43 @@ inline ColorBufferFormat ColorBuffer::get_format() const
     return m_format;
 }
 
+inline size_t ColorBuffer::get_elem_size(ColorBufferFormat format)
+{
+    switch (format)
+    {
+        case ColorBufferFormat::ARGB8:
+        case ColorBufferFormat::xBGR8:
+            return sizeof(uint32_t);
+
+        case ColorBufferFormat::RGB565: return sizeof(uint16_t);
+        case ColorBufferFormat::RGBA16F: return 4 * sizeof(uint16_t);
+    }
+    throw std::runtime_error("unknown color buffer format");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// DepthBuffer impl
+///////////////////////////////////////////////////////////////////////////////
+inline DepthBuffer::DepthBuffer(DepthBufferFormat format) :
+    m_format(format)
+{}
+
+inline DepthBufferFormat DepthBuffer::get_format() const
+{
+    return m_format;
+}
+
+inline size_t DepthBuffer::get_elem_size(DepthBufferFormat format)
+{
+    switch (format)
+    {
+        case DepthBufferFormat::F32: return sizeof(float);
+        case DepthBufferFormat::U24: return sizeof(uint32_t);
+        case DepthBufferFormat::U16: return sizeof(uint16_t);
+    }
+    throw std::runtime_error("unknown depth buffer format");
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // DeviceBuffer impl
 ///////////////////////////////////////////////////////////////////////////////
@@ -186,10 +316,19 @@ inline void lock_buffer(DeviceBuffer* buffer, Func fun)
 ///////////////////////////////////////////////////////////////////////////////
 // VertexDecl impl
 ///////////////////////////////////////////////////////////////////////////////
+inline VertexDecl::VertexDecl(VertexLayout layout, const void* format_id) :
+    m_layout(layout),
+    m_format_id(format_id)
+{}
+
 inline void VertexDecl::add(VertexType type, VertexSemantic semantic)
 {
-    m_elems.emplace_back(m_offset, type, semantic);
-    m_offset += get_elem_size(type);
+    if (m_strides.empty() || m_layout == VertexLayout::Deinterleaved)
+        m_strides.push_back(0);
+
+    const size_t stream = m_strides.size() - 1;
+    m_elems.emplace_back(stream, m_strides[stream], type, semantic);
+    m_strides[stream] += get_elem_size(type);
 }
 
 inline VertexDecl::iterator VertexDecl::begin() const
@@ -202,12 +341,29 @@ inline VertexDecl::iterator VertexDecl::end() const
     return m_elems.end();
 }
 
+inline VertexLayout VertexDecl::get_layout() const
+{
+    return m_layout;
+}
+
+inline const void* VertexDecl::get_format_id() const
+{
+    return m_format_id;
+}
+
+inline size_t VertexDecl::get_stream_count() const
+{
+    return m_strides.size();
+}
+
+inline size_t VertexDecl::get_stride(size_t stream) const
+{
+    return m_strides[stream];
+}
+
 inline size_t VertexDecl::get_vertex_size() const
 {
-    return std::accumulate(
-        m_elems.begin(), m_elems.end(),
-        size_t(0), [](size_t v, auto& e) { return v + get_elem_size(e.type); }
-    );
+    return std::accumulate(m_strides.begin(), m_strides.end(), size_t(0));
 }
 
 inline size_t VertexDecl::get_elem_size(VertexType type)
@@ -222,6 +378,18 @@ inline size_t VertexDecl::get_elem_size(VertexType type)
 
         case VertexType::Color:
             return 4 * sizeof(float);
+
+        case VertexType::Short4N:
+            return 4 * sizeof(int16_t);
+
+        case VertexType::Oct16:
+            return 2 * sizeof(int16_t);
+
+        case VertexType::UShort2N:
+            return 2 * sizeof(uint16_t);
+
+        case VertexType::ColorU8:
+            return sizeof(uint32_t);
     }
     throw std::runtime_error("unknown vertex decl element");
 }
@@ -232,7 +400,17 @@ inline size_t VertexDecl::get_elem_size(VertexType type)
 inline VertexBuffer::VertexBuffer(std::unique_ptr<VertexDecl> decl, size_t count) :
     m_decl(std::move(decl)),
     m_count(count)
-{}
+{
+    const size_t align = detail::VERTEX_STREAM_ALIGNMENT;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < m_decl->get_stream_count(); i++)
+    {
+        m_stream_offsets.push_back(offset);
+        offset = (offset + m_decl->get_stride(i) * m_count + align - 1) & ~(align - 1);
+    }
+    m_stream_offsets.push_back(offset);
+}
 
 inline const VertexDecl& VertexBuffer::get_declaration() const
 {
@@ -244,11 +422,38 @@ inline size_t VertexBuffer::get_count() const
     return m_count;
 }
 
+inline size_t VertexBuffer::get_stream_offset(size_t stream) const
+{
+    return m_stream_offsets[stream];
+}
+
+inline size_t VertexBuffer::get_data_size() const
+{
+    return m_stream_offsets.back();
+}
+
+inline void VertexBuffer::set_position_transform(const vec3& scale, const vec3& offset)
+{
+    m_position_scale = scale;
+    m_position_offset = offset;
+}
+
+inline const vec3& VertexBuffer::get_position_scale() const
+{
+    return m_position_scale;
+}
+
+inline const vec3& VertexBuffer::get_position_offset() const
+{
+    return m_position_offset;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // IndexBuffer impl
 ///////////////////////////////////////////////////////////////////////////////
-inline IndexBuffer::IndexBuffer(size_t count) :
-    m_count(count)
+inline IndexBuffer::IndexBuffer(size_t count, IndexFormat format) :
+    m_count(count),
+    m_format(format)
 {}
 
 inline size_t IndexBuffer::get_count() const
@@ -256,6 +461,26 @@ inline size_t IndexBuffer::get_count() const
     return m_count;
 }
 
+inline IndexFormat IndexBuffer::get_format() const
+{
+    return m_format;
+}
+
+inline size_t IndexBuffer::get_elem_size(IndexFormat format)
+{
+    switch (format)
+    {
+        case IndexFormat::U16: return sizeof(uint16_t);
+        case IndexFormat::U32: return sizeof(uint32_t);
+    }
+    throw std::runtime_error("unknown index format");
+}
+
+inline IndexFormat IndexBuffer::get_format_for(size_t vertex_count)
+{
+    return vertex_count <= std::numeric_limits<uint16_t>::max() + size_t(1) ? IndexFormat::U16 : IndexFormat::U32;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Texture impl
 ///////////////////////////////////////////////////////////////////////////////
@@ -265,6 +490,14 @@ inline size_t Texture::get_elem_size(PixelFormat format)
     {
         case PixelFormat::RgbaU8: return 4;
         case PixelFormat::RgbU8: return 3;
+        case PixelFormat::Bc1: break;
     }
     throw std::runtime_error("unknown pixel format");
 }
+
+inline size_t Texture::get_data_size(PixelFormat format, size_t width, size_t height)
+{
+    if (format == PixelFormat::Bc1)
+        return bc1_get_data_size(width, height);
+    return width * height * get_elem_size(format);
+}
@@ -40,14 +40,18 @@ shared_ptr<Material> RenderCache::get_material(const string& name)
                 1.0f
             };
             default_mat.diffuse_map = m_asset.load_image("default_tex.bmp");
-            return make_unique<Material>(default_mat, m_render);
+            return make_unique<Material>(default_mat, m_render, m_compress_maps);
         }
-        return make_unique<Material>(*raw_mat, m_render);
+        return make_unique<Material>(*raw_mat, m_render, m_compress_maps);
     });
 
     // TODO: some factory customization here (and COW materials)
     if (name.find("axis.3ds") != string::npos)
         ret->set_lighting_enable(false);
+    if (name.find(":prefab/color_cube") != string::npos)
+        ret->set_shading_mode(ShadingMode::Gouraud);
+    if (name.find("ship.3ds") != string::npos)
+        ret->set_shading_rate(ShadingRate::Rate2x2);
     return ret;
 }
 
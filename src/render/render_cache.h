@@ -18,6 +18,10 @@ public:
     std::shared_ptr<Mesh> get_mesh(const std::string& name);
     std::shared_ptr<Model> get_model(const std::string& name);
 
+    // block compression of the diffuse maps, applies to materials created after the call
+    void set_compress_maps(bool enable);
+    bool get_compress_maps() const;
+
     void clear();
 
 private:
@@ -33,6 +37,8 @@ private:
     cache_t<Mesh> m_meshes;
     cache_t<Material> m_materials;
     cache_t<Model> m_models;
+
+    bool m_compress_maps = true;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -54,6 +60,16 @@ inline RenderCache::~RenderCache()
     log_info("Destroyed rendering cache");
 }
 
+inline void RenderCache::set_compress_maps(bool enable)
+{
+    m_compress_maps = enable;
+}
+
+inline bool RenderCache::get_compress_maps() const
+{
+    return m_compress_maps;
+}
+
 template <typename T, typename Creator>
 inline std::shared_ptr<T> RenderCache::cache_get(cache_t<T>& cache, const std::string& name, Creator create)
 {
@@ -1,14 +1,33 @@
 #pragma once
 
+#include "math3.h"
+
 class VertexBuffer;
 class IndexBuffer;
 
+// index range culled as a unit, the device side copy of GeometryAsset::Meshlet
+struct RenderMeshlet
+{
+    uint32_t first_index;
+    uint32_t index_count;
+
+    vec3 center;
+    float radius;
+
+    vec3 cone_axis;
+    float cone_cos;
+    float cone_sin;
+};
+using RenderMeshlets = std::vector<RenderMeshlet>;
+
 struct RenderPrimitive
 {
     VertexBuffer& vertices;
     IndexBuffer& indices;
+    // optional, clusters covering the whole index list that can be culled as a unit
+    const RenderMeshlets* meshlets;
 
-    RenderPrimitive(VertexBuffer& vertices, IndexBuffer& indices) :
-        vertices(vertices), indices(indices)
+    RenderPrimitive(VertexBuffer& vertices, IndexBuffer& indices, const RenderMeshlets* meshlets = nullptr) :
+        vertices(vertices), indices(indices), meshlets(meshlets)
     {}
 };
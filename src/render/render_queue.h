@@ -17,8 +17,9 @@ public:
         const mat4& world_matrix;
         const mat4& world_inv_matrix;
         const Model::Unit& model_unit;
+        bool is_static;
 
-        Item(const mat4& world_matrix, const mat4& world_inv_matrix, const Model::Unit& model_unit);
+        Item(const mat4& world_matrix, const mat4& world_inv_matrix, const Model::Unit& model_unit, bool is_static);
     };
 
     using iterator = std::vector<Item>::const_iterator;
@@ -31,17 +32,25 @@ public:
     void add(Args&&... args);
     void clear();
 
+    // changes whenever the static items or the view they get drawn with change, survives clear
+    void set_static_version(uint32_t version);
+    uint32_t get_static_version() const;
+
 private:
     std::vector<Item> m_items;
+    uint32_t m_static_version = 0;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 // RenderQueue::Item impl
 ///////////////////////////////////////////////////////////////////////////////
-inline RenderQueue::Item::Item(const mat4& world_matrix, const mat4& world_inv_matrix, const Model::Unit& model_unit) :
+inline RenderQueue::Item::Item(
+    const mat4& world_matrix, const mat4& world_inv_matrix, const Model::Unit& model_unit, bool is_static
+) :
     world_matrix(world_matrix),
     world_inv_matrix(world_inv_matrix),
-    model_unit(model_unit)
+    model_unit(model_unit),
+    is_static(is_static)
 {}
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -67,3 +76,13 @@ inline void RenderQueue::clear()
 {
     m_items.clear();
 }
+
+inline void RenderQueue::set_static_version(uint32_t version)
+{
+    m_static_version = version;
+}
+
+inline uint32_t RenderQueue::get_static_version() const
+{
+    return m_static_version;
+}
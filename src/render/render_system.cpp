@@ -37,22 +37,54 @@ void RenderSystem::process()
 {
     m_dev->clear();
 
-    auto& p = m_dev->get_params();
-    for (auto& qi : m_queue)
+    if (!m_static_layer)
     {
-        p.set_world_matrix(qi.world_matrix);
-        p.set_world_inv_matrix(qi.world_inv_matrix);
-
-        const auto& material = qi.model_unit.get_material();
-        p.set_material(material);
+        for (auto& qi : m_queue)
+            draw_item(qi);
+    }
+    else
+    {
+        // static items come from the layer when nothing they depend on changed, else they get drawn
+        // and the layer snapshot is taken before the dynamic ones go on top
+        const bool restored =
+            m_layer_valid && m_layer_version == m_queue.get_static_version() && m_dev->restore_layer();
+        if (!restored)
+        {
+            for (auto& qi : m_queue)
+            {
+                if (qi.is_static)
+                    draw_item(qi);
+            }
 
-        const auto& textures = material.get_textures();
-        for (size_t i = 0; i < m_dev->get_texture_unit_count(); i++)
-            m_dev->set_texture_unit(i, i < textures.size() ? textures[i] : nullptr);
+            m_dev->store_layer();
+            m_layer_valid = true;
+            m_layer_version = m_queue.get_static_version();
+        }
 
-        m_dev->draw_primitive(qi.model_unit.get_primitive());
+        for (auto& qi : m_queue)
+        {
+            if (!qi.is_static)
+                draw_item(qi);
+        }
     }
+    m_dev->flush();
 
     m_context.on_render();
     m_dev->swap_buffers();
 }
+
+void RenderSystem::draw_item(const RenderQueue::Item& item)
+{
+    auto& p = m_dev->get_params();
+    p.set_world_matrix(item.world_matrix);
+    p.set_world_inv_matrix(item.world_inv_matrix);
+
+    const auto& material = item.model_unit.get_material();
+    p.set_material(material);
+
+    const auto& textures = material.get_textures();
+    for (size_t i = 0; i < m_dev->get_texture_unit_count(); i++)
+        m_dev->set_texture_unit(i, i < textures.size() ? textures[i] : nullptr);
+
+    m_dev->draw_primitive(item.model_unit.get_primitive());
+}
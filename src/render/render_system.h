@@ -43,22 +43,28 @@ public:
     virtual void set_polygon_mode(PolygonMode mode) = 0;
     virtual void set_render_target(RenderTarget* target) = 0;
     virtual void set_texture_unit(size_t index, const Texture* texture) = 0;
-    virtual void set_light_unit(size_t index, const Light* light) = 0;
+    virtual void set_lights(const std::vector<const Light*>& lights) = 0;
     virtual Params& get_params() = 0;
 
     // resource management methods
     virtual std::unique_ptr<RenderTarget> create_render_target(int width, int height) = 0;
     virtual std::unique_ptr<VertexBuffer> create_vertex_buffer(std::unique_ptr<VertexDecl> decl, size_t count) = 0;
-    virtual std::unique_ptr<IndexBuffer> create_index_buffer(size_t count) = 0;
+    virtual std::unique_ptr<IndexBuffer> create_index_buffer(size_t count, IndexFormat format) = 0;
     virtual std::unique_ptr<Texture> create_texture(size_t width, size_t height, PixelFormat format) = 0;
 
     // capabilities methods
     virtual size_t get_texture_unit_count() const = 0;
-    virtual size_t get_light_unit_count() const = 0;
 
     // framebuffer methods
     virtual void clear() = 0;
+    // draws anything the device deferred, needed before drawing on top of the scene
+    virtual void flush() = 0;
     virtual void swap_buffers() = 0;
+
+    // static layer: store_layer snapshots the color and depth drawn so far in the frame, restore_layer
+    // puts them back right after a clear; false when there is no snapshot that fits the current target
+    virtual void store_layer() = 0;
+    virtual bool restore_layer() = 0;
 };
 
 class RenderSystem : public Subsystem
@@ -69,20 +75,44 @@ public:
 
     void process() final;
 
+    // NOTE: static items get drawn once into a layer that the following frames start from, until the
+    // scene reports a camera or static item change; device state changes need an explicit invalidate
+    void set_static_layer(bool enable);
+    void invalidate_static_layer();
+
 public:
     RenderDevice& get_device();
     RenderQueue& get_queue();
     RenderCache& get_cache();
 
+protected:
+    void draw_item(const RenderQueue::Item& item);
+
 protected:
     std::unique_ptr<RenderDevice> m_dev;
     RenderQueue m_queue;
     RenderCache m_cache;
+
+    bool m_static_layer = false;
+    bool m_layer_valid = false;
+    // static version of the queue the layer was drawn from
+    uint32_t m_layer_version = 0;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Renderer impl
 ///////////////////////////////////////////////////////////////////////////////
+inline void RenderSystem::set_static_layer(bool enable)
+{
+    m_static_layer = enable;
+    m_layer_valid = false;
+}
+
+inline void RenderSystem::invalidate_static_layer()
+{
+    m_layer_valid = false;
+}
+
 inline RenderDevice& RenderSystem::get_device()
 {
     return *m_dev;
@@ -5,11 +5,11 @@
 ///////////////////////////////////////////////////////////////////////////////
 // SoftwareDepthBuffer impl
 ///////////////////////////////////////////////////////////////////////////////
-SoftwareDepthBuffer::SoftwareDepthBuffer(int width, int height) :
-    BufferStorage(width * height)
+SoftwareDepthBuffer::SoftwareDepthBuffer(int width, int height, DepthBufferFormat format) :
+    BufferStorage(0, format)
 {
     resize(width, height);
-    log_info("Created software depth buffer");
+    log_info("Created software depth buffer, format = %d", static_cast<int>(format));
 }
 
 void SoftwareDepthBuffer::resize(int width, int height)
@@ -21,29 +21,97 @@ void SoftwareDepthBuffer::resize(int width, int height)
     m_width = width;
     m_height = height;
 
-    m_data.reset(new float[height * width]);
+    // NOTE: storage only grows, dynamic resolution shrinks and regrows the same target all the time
+    const size_t size = height * width * get_elem_size(m_format);
+    if (size > m_capacity)
+    {
+        m_data.reset(new uint8_t[size]);
+        m_capacity = size;
+    }
 }
 
 void SoftwareDepthBuffer::clear()
 {
-    float* data = lock();
-    std::fill(data, data + m_width * m_height, std::numeric_limits<float>::max());
+    uint8_t* data = lock();
+    detail::dispatch_depth_format(m_format, [&](auto format)
+    {
+        using Format = decltype(format);
+        auto* values = reinterpret_cast<typename Format::value_type*>(data);
+        std::fill(values, values + m_width * m_height, Format::CLEAR);
+    });
+    unlock();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SoftwareColorBuffer impl
+///////////////////////////////////////////////////////////////////////////////
+SoftwareColorBuffer::SoftwareColorBuffer(int width, int height, ColorBufferFormat format) :
+    BufferStorage(0, format)
+{
+    resize(width, height);
+    log_info("Created software color buffer, format = %d", static_cast<int>(format));
+}
+
+void SoftwareColorBuffer::resize(int width, int height)
+{
+    if (m_width == static_cast<size_t>(width) && m_height == static_cast<size_t>(height))
+        return;
+
+    // update dimensions
+    m_width = width;
+    m_height = height;
+
+    // NOTE: storage only grows, dynamic resolution shrinks and regrows the same target all the time
+    const size_t size = height * width * get_elem_size(m_format);
+    if (size > m_capacity)
+    {
+        m_data.reset(new uint8_t[size]);
+        m_capacity = size;
+    }
+}
+
+void SoftwareColorBuffer::clear()
+{
+    std::memset(lock(), 0, m_width * m_height * get_elem_size(m_format));
     unlock();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// SoftwareRenderTarget impl
+///////////////////////////////////////////////////////////////////////////////
+SoftwareRenderTarget::SoftwareRenderTarget(
+    int width, int height, ColorBufferFormat color_format, DepthBufferFormat depth_format
+) :
+    m_color_buf{ width, height, color_format },
+    m_depth_buf{ width, height, depth_format },
+    m_width{ width },
+    m_height{ height }
+{}
+
+void SoftwareRenderTarget::resize(int width, int height)
+{
+    m_color_buf.resize(width, height);
+    m_depth_buf.resize(width, height);
+
+    m_width = width;
+    m_height = height;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // SoftwareTexture impl
 ///////////////////////////////////////////////////////////////////////////////
 SoftwareTexture::SoftwareTexture(size_t width, size_t height, PixelFormat format) :
-    BufferStorage(width * height * 4),
+    BufferStorage(format == PixelFormat::Bc1 ? Texture::get_data_size(format, width, height) : width * height * 4),
     m_width(width),
     m_height(height),
-    m_format(format)
+    m_format(format),
+    m_pow2((width & (width - 1)) == 0 && (height & (height - 1)) == 0)
 {}
 
 uint8_t* SoftwareTexture::lock()
 {
-    if (m_format == PixelFormat::RgbaU8)
+    // NOTE: compressed data is kept as-is and decoded on sampling
+    if (m_format == PixelFormat::RgbaU8 || m_format == PixelFormat::Bc1)
         return BufferStorage::lock();
 
     // NOTE: simplification for rasterizer
@@ -22,12 +22,124 @@ namespace detail
 
         std::unique_ptr<T[]> m_data;
     };
+
+    // bilinear blend of 4 packed rgba8 texels, fx/fy are the 8bit fractional weights
+    inline uint32_t rgba8_bilerp(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11, uint32_t fx, uint32_t fy);
+
+    // depth formats as stored, encode maps a device z to a value that orders as an integer; the clear
+    // value is above anything encode returns, so a cleared pixel always passes the less-than test
+    struct DepthF32
+    {
+        using value_type = uint32_t;
+        static constexpr value_type CLEAR = 0x7f7fffff;  // FLT_MAX bits
+
+        static value_type encode(float z);
+#ifdef HAS_SSE2
+        static __m128i encode4(__m128 z);
+        static __m128i load4(const value_type* ptr);
+#endif
+    };
+
+    struct DepthU24
+    {
+        using value_type = uint32_t;
+        static constexpr value_type CLEAR = 0xffffff;
+
+        static value_type encode(float z);
+#ifdef HAS_SSE2
+        static __m128i encode4(__m128 z);
+        static __m128i load4(const value_type* ptr);
+#endif
+    };
+
+    struct DepthU16
+    {
+        using value_type = uint16_t;
+        static constexpr value_type CLEAR = 0xffff;
+
+        static value_type encode(float z);
+#ifdef HAS_SSE2
+        static __m128i encode4(__m128 z);
+        static __m128i load4(const value_type* ptr);
+#endif
+    };
+
+    // calls fun with the traits of the format
+    template <typename Func>
+    void dispatch_depth_format(DepthBufferFormat format, Func&& fun);
+
+    // [0, 1] to [0, scale] rounded to nearest, nan ends up as 0; same results as the SIMD packers
+    inline uint32_t unorm_encode(float value, float scale);
+
+    // color formats as stored; pack4 converts a group of 4 float fragments (rgba), pack4_rgba8 one of
+    // 4 packed rgba8 ones and unpack_rgba8 reads a pixel back as rgba8, formats without alpha read opaque
+    struct ColorARGB8
+    {
+        using value_type = uint32_t;
+
+        static void pack4(const float (*colors)[4], value_type* out);
+        static void pack4_rgba8(const uint32_t* rgba, value_type* out);
+        static uint32_t unpack_rgba8(value_type value);
+    };
+
+    struct ColorXBGR8
+    {
+        using value_type = uint32_t;
+
+        static void pack4(const float (*colors)[4], value_type* out);
+        static void pack4_rgba8(const uint32_t* rgba, value_type* out);
+        static uint32_t unpack_rgba8(value_type value);
+    };
+
+    struct ColorRGB565
+    {
+        using value_type = uint16_t;
+
+        static void pack4(const float (*colors)[4], value_type* out);
+        static void pack4_rgba8(const uint32_t* rgba, value_type* out);
+        static uint32_t unpack_rgba8(value_type value);
+    };
+
+    // NOTE: the channels stay unclamped up to the largest half, under the smallest normal half is 0
+    struct ColorRGBA16F
+    {
+        using value_type = uint64_t;
+
+        static void pack4(const float (*colors)[4], value_type* out);
+        static void pack4_rgba8(const uint32_t* rgba, value_type* out);
+        static uint32_t unpack_rgba8(value_type value);
+
+        static uint16_t float_to_half(float value);
+        static float half_to_float(uint16_t value);
+    };
+
+    // calls fun with the traits of the format
+    template <typename Func>
+    void dispatch_color_format(ColorBufferFormat format, Func&& fun);
 }
 
-class SoftwareDepthBuffer : public detail::BufferStorage<DepthBuffer, float>
+// NOTE: offscreen color, cleared to zero which is black in every format
+class SoftwareColorBuffer : public detail::BufferStorage<ColorBuffer, uint8_t>
+{
+public:
+    SoftwareColorBuffer(int width, int height, ColorBufferFormat format);
+    ~SoftwareColorBuffer() = default;
+
+    size_t get_stride() final;
+
+    void resize(int width, int height);
+    void clear();
+
+private:
+    size_t m_width = 0;
+    size_t m_height = 0;
+    size_t m_capacity = 0;
+};
+
+class SoftwareDepthBuffer : public detail::BufferStorage<DepthBuffer, uint8_t>
 {
 public:
-    SoftwareDepthBuffer(int width, int height);
+    SoftwareDepthBuffer(int width, int height, DepthBufferFormat format = DepthBufferFormat::F32);
     ~SoftwareDepthBuffer() = default;
 
     size_t get_stride() final;
@@ -38,19 +150,54 @@ public:
 private:
     size_t m_width = 0;
     size_t m_height = 0;
+    size_t m_capacity = 0;
+};
+
+// NOTE: render target in plain memory, nothing presents it; it gets resolved into another target
+class SoftwareRenderTarget : public RenderTarget
+{
+public:
+    SoftwareRenderTarget(int width, int height, ColorBufferFormat color_format, DepthBufferFormat depth_format);
+    ~SoftwareRenderTarget() = default;
+
+    ColorBuffer& get_color_buffer() final;
+    DepthBuffer& get_depth_buffer() final;
+
+    int get_width() const final;
+    int get_height() const final;
+
+    void resize(int width, int height);
+
+private:
+    SoftwareColorBuffer m_color_buf;
+    SoftwareDepthBuffer m_depth_buf;
+
+    int m_width, m_height;
 };
 
 class SoftwareVertexBuffer : public detail::BufferStorage<VertexBuffer, uint8_t>
 {
+public:
+    // data of a single element, vertex i is at data + i * stride
+    struct Stream
+    {
+        const uint8_t* data;
+        size_t stride;
+        VertexType type;
+    };
+
 public:
     SoftwareVertexBuffer(std::unique_ptr<VertexDecl> decl, size_t count);
     ~SoftwareVertexBuffer() = default;
+
+    // data is null when the declaration doesnt have the semantic
+    Stream get_stream(VertexSemantic semantic) const;
 };
 
 class SoftwareIndexBuffer : public detail::BufferStorage<IndexBuffer, uint8_t>
 {
 public:
-    SoftwareIndexBuffer(size_t count);
+    SoftwareIndexBuffer(size_t count, IndexFormat format);
     ~SoftwareIndexBuffer() = default;
 };
 
@@ -67,11 +214,20 @@ public:
     size_t get_height() const final;
     PixelFormat get_format() const final;
 
-    Color sample(float u, float v) const;
+    // nearest texel
+    Color sample(float u, float v, TextureAddress address) const;
+    // bilinear, u, v in texel space 8.8 fixed point, returns packed rgba8 (r in lowest byte)
+    uint32_t sample_fixed(int32_t u, int32_t v, TextureAddress address) const;
+
+private:
+    int32_t wrap(int32_t coord, int32_t size, TextureAddress address) const;
+    uint32_t fetch(size_t x, size_t y) const;
 
 private:
     size_t m_width, m_height;
     PixelFormat m_format;
+    // both dimensions are powers of 2, wrapping is just masking
+    bool m_pow2;
     std::vector<uint8_t> m_rgb8u_data;
 };
 
@@ -110,18 +266,63 @@ inline size_t SoftwareDepthBuffer::get_stride()
     return m_width;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// SoftwareColorBuffer impl
+///////////////////////////////////////////////////////////////////////////////
+inline size_t SoftwareColorBuffer::get_stride()
+{
+    return m_width;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SoftwareRenderTarget impl
+///////////////////////////////////////////////////////////////////////////////
+inline ColorBuffer& SoftwareRenderTarget::get_color_buffer()
+{
+    return m_color_buf;
+}
+
+inline DepthBuffer& SoftwareRenderTarget::get_depth_buffer()
+{
+    return m_depth_buf;
+}
+
+inline int SoftwareRenderTarget::get_width() const
+{
+    return m_width;
+}
+
+inline int SoftwareRenderTarget::get_height() const
+{
+    return m_height;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // SoftwareVertexBuffer impl
 ///////////////////////////////////////////////////////////////////////////////
 inline SoftwareVertexBuffer::SoftwareVertexBuffer(std::unique_ptr<VertexDecl> decl, size_t count) :
-    BufferStorage(decl->get_vertex_size() * count, std::move(decl), count)
-{}
+    BufferStorage(0, std::move(decl), count)
+{
+    // stream layout is only known once the base has the declaration
+    m_data.reset(new uint8_t[get_data_size()]);
+}
+
+inline SoftwareVertexBuffer::Stream SoftwareVertexBuffer::get_stream(VertexSemantic semantic) const
+{
+    const VertexDecl& decl = get_declaration();
+    for (auto& e : decl)
+    {
+        if (e.semantic == semantic)
+            return Stream{ data() + get_stream_offset(e.stream) + e.offset, decl.get_stride(e.stream), e.type };
+    }
+    return Stream{ nullptr, 0, VertexType::Float3 };
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // SoftwareIndexBuffer impl
 ///////////////////////////////////////////////////////////////////////////////
-inline SoftwareIndexBuffer::SoftwareIndexBuffer(size_t count) :
-    BufferStorage(sizeof(uint16_t) * count, count)
+inline SoftwareIndexBuffer::SoftwareIndexBuffer(size_t count, IndexFormat format) :
+    BufferStorage(get_elem_size(format) * count, count, format)
 {}
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -142,10 +343,424 @@ inline PixelFormat SoftwareTexture::get_format() const
     return m_format;
 }
 
-inline Color SoftwareTexture::sample(float u, float v) const
+inline Color SoftwareTexture::sample(float u, float v, TextureAddress address) const
+{
+    // nearest texel, only the packed unlit path filters thru sample_fixed
+    const int32_t width = static_cast<int32_t>(m_width);
+    const int32_t height = static_cast<int32_t>(m_height);
+    const uint32_t texel = fetch(
+        wrap(static_cast<int32_t>(floor(u * m_width)), width, address),
+        wrap(static_cast<int32_t>(floor(v * m_height)), height, address)
+    );
+    return Color{
+        (texel & 0xff) / 255.0f,
+        ((texel >> 8) & 0xff) / 255.0f,
+        ((texel >> 16) & 0xff) / 255.0f,
+        (texel >> 24) / 255.0f
+    };
+}
+
+inline uint32_t SoftwareTexture::sample_fixed(int32_t u, int32_t v, TextureAddress address) const
+{
+    // move to texel centers, integer part selects the 2x2 footprint, fraction the weights
+    u -= 128;
+    v -= 128;
+
+    const int32_t width = static_cast<int32_t>(m_width);
+    const int32_t height = static_cast<int32_t>(m_height);
+    const size_t x0 = wrap(u >> 8, width, address);
+    const size_t x1 = wrap((u >> 8) + 1, width, address);
+    const size_t y0 = wrap(v >> 8, height, address);
+    const size_t y1 = wrap((v >> 8) + 1, height, address);
+
+    return detail::rgba8_bilerp(
+        fetch(x0, y0), fetch(x1, y0),
+        fetch(x0, y1), fetch(x1, y1),
+        u & 0xff, v & 0xff
+    );
+}
+
+inline int32_t SoftwareTexture::wrap(int32_t coord, int32_t size, TextureAddress address) const
+{
+    switch (address)
+    {
+        case TextureAddress::Repeat:
+            if (m_pow2)
+                return coord & (size - 1);
+            coord %= size;
+            return coord < 0 ? coord + size : coord;
+
+        case TextureAddress::Mirror:
+            // odd periods run backwards
+            if (m_pow2)
+                return ((coord & size) ? ~coord : coord) & (size - 1);
+            coord %= 2 * size;
+            if (coord < 0)
+                coord += 2 * size;
+            return coord < size ? coord : 2 * size - 1 - coord;
+
+        case TextureAddress::Clamp:
+            break;
+    }
+    return clamp(coord, 0, size - 1);
+}
+
+inline uint32_t SoftwareTexture::fetch(size_t x, size_t y) const
 {
-    const size_t x = clamp(static_cast<size_t>(u * m_width), size_t(0), m_width - 1);
-    const size_t y = clamp(static_cast<size_t>(v * m_height), size_t(0), m_height - 1);
+    if (m_format == PixelFormat::Bc1)
+        return bc1_decode(m_data.get(), m_width, x, y);
+
     const uint8_t* data = m_data.get() + (y * m_width + x) * 4;
-    return Color{ data[0] / 255.0f, data[1] / 255.0f, data[2] / 255.0f, data[3] / 255.0f };
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// detail impl
+///////////////////////////////////////////////////////////////////////////////
+inline detail::DepthF32::value_type detail::DepthF32::encode(float z)
+{
+    // NOTE: non-negative floats order the same as their bits; written so -0 and nan end up as +0 like encode4
+    const float value = z > 0.0f ? z : 0.0f;
+    value_type bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline detail::DepthU24::value_type detail::DepthU24::encode(float z)
+{
+    const float unit = ::min(z > 0.0f ? z : 0.0f, 1.0f);
+    return static_cast<value_type>(unit * (CLEAR - 1) + 0.5f);
+}
+
+inline detail::DepthU16::value_type detail::DepthU16::encode(float z)
+{
+    const float unit = ::min(z > 0.0f ? z : 0.0f, 1.0f);
+    return static_cast<value_type>(unit * (CLEAR - 1) + 0.5f);
+}
+
+#ifdef HAS_SSE2
+inline __m128i detail::DepthF32::encode4(__m128 z)
+{
+    return _mm_castps_si128(_mm_max_ps(z, _mm_setzero_ps()));
+}
+
+inline __m128i detail::DepthF32::load4(const value_type* ptr)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+}
+
+inline __m128i detail::DepthU24::encode4(__m128 z)
+{
+    const __m128 unit = _mm_min_ps(_mm_max_ps(z, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(unit, _mm_set1_ps(CLEAR - 1)), _mm_set1_ps(0.5f)));
+}
+
+inline __m128i detail::DepthU24::load4(const value_type* ptr)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+}
+
+inline __m128i detail::DepthU16::encode4(__m128 z)
+{
+    const __m128 unit = _mm_min_ps(_mm_max_ps(z, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(unit, _mm_set1_ps(CLEAR - 1)), _mm_set1_ps(0.5f)));
+}
+
+inline __m128i detail::DepthU16::load4(const value_type* ptr)
+{
+    // widened to 32bit lanes, same as what encode4 returns
+    return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr)), _mm_setzero_si128());
+}
+#endif
+
+template <typename Func>
+inline void detail::dispatch_depth_format(DepthBufferFormat format, Func&& fun)
+{
+    switch (format)
+    {
+        case DepthBufferFormat::F32:
+            fun(DepthF32{});
+            return;
+
+        case DepthBufferFormat::U24:
+            fun(DepthU24{});
+            return;
+
+        case DepthBufferFormat::U16:
+            fun(DepthU16{});
+            return;
+    }
+    throw std::runtime_error("unknown depth buffer format");
+}
+
+inline uint32_t detail::unorm_encode(float value, float scale)
+{
+    const float unit = ::min(value > 0.0f ? value : 0.0f, 1.0f);
+    return static_cast<uint32_t>(std::lrint(unit * scale));
+}
+
+#ifdef HAS_SSE2
+namespace detail
+{
+    // 4 fragments to unorm8 in one register, pixel i in dword i; the shuffle picks the byte order
+    template <int Shuffle>
+    inline __m128i pack4_unorm8(const float (*colors)[4])
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+
+        __m128i v[4];
+        for (int i = 0; i < 4; i++)
+        {
+            __m128 c = _mm_loadu_ps(colors[i]);
+            c = _mm_shuffle_ps(c, c, Shuffle);
+            v[i] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(c, zero), one), scale));
+        }
+        return _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+    }
+}
+#endif
+
+inline void detail::ColorARGB8::pack4(const float (*colors)[4], value_type* out)
+{
+#ifdef HAS_SSE2
+    const __m128i bgra = pack4_unorm8<_MM_SHUFFLE(3, 0, 1, 2)>(colors);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_and_si128(bgra, _mm_set1_epi32(0xffffff)));
+#else
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] =
+            (unorm_encode(colors[i][0], 255.0f) << 16) |
+            (unorm_encode(colors[i][1], 255.0f) << 8) |
+            unorm_encode(colors[i][2], 255.0f);
+    }
+#endif
+}
+
+inline void detail::ColorARGB8::pack4_rgba8(const uint32_t* rgba, value_type* out)
+{
+    for (int i = 0; i < 4; i++)
+        out[i] = ((rgba[i] & 0xff) << 16) | (rgba[i] & 0xff00) | ((rgba[i] >> 16) & 0xff);
+}
+
+inline uint32_t detail::ColorARGB8::unpack_rgba8(value_type value)
+{
+    return ((value & 0xff) << 16) | (value & 0xff00) | ((value >> 16) & 0xff) | 0xff000000;
+}
+
+inline void detail::ColorXBGR8::pack4(const float (*colors)[4], value_type* out)
+{
+#ifdef HAS_SSE2
+    const __m128i rgba = pack4_unorm8<_MM_SHUFFLE(3, 2, 1, 0)>(colors);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_and_si128(rgba, _mm_set1_epi32(0xffffff)));
+#else
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] =
+            unorm_encode(colors[i][0], 255.0f) |
+            (unorm_encode(colors[i][1], 255.0f) << 8) |
+            (unorm_encode(colors[i][2], 255.0f) << 16);
+    }
+#endif
+}
+
+inline void detail::ColorXBGR8::pack4_rgba8(const uint32_t* rgba, value_type* out)
+{
+    for (int i = 0; i < 4; i++)
+        out[i] = rgba[i] & 0xffffff;
+}
+
+inline uint32_t detail::ColorXBGR8::unpack_rgba8(value_type value)
+{
+    return value | 0xff000000;
+}
+
+inline void detail::ColorRGB565::pack4(const float (*colors)[4], value_type* out)
+{
+#ifdef HAS_SSE2
+    // channel per register, 4 pixels each
+    __m128 r = _mm_loadu_ps(colors[0]);
+    __m128 g = _mm_loadu_ps(colors[1]);
+    __m128 b = _mm_loadu_ps(colors[2]);
+    __m128 a = _mm_loadu_ps(colors[3]);
+    _MM_TRANSPOSE4_PS(r, g, b, a);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const auto unorm = [&](__m128 c, float scale)
+    {
+        return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(c, zero), one), _mm_set1_ps(scale)));
+    };
+
+    const __m128i rgb = _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi32(unorm(r, 31.0f), 11), _mm_slli_epi32(unorm(g, 63.0f), 5)),
+        unorm(b, 31.0f)
+    );
+
+    // NOTE: sign extended from 16bits so the signed saturation leaves the bits alone
+    const __m128i packed = _mm_srai_epi32(_mm_slli_epi32(rgb, 16), 16);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(packed, packed));
+#else
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = static_cast<value_type>(
+            (unorm_encode(colors[i][0], 31.0f) << 11) |
+            (unorm_encode(colors[i][1], 63.0f) << 5) |
+            unorm_encode(colors[i][2], 31.0f)
+        );
+    }
+#endif
+}
+
+inline void detail::ColorRGB565::pack4_rgba8(const uint32_t* rgba, value_type* out)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = static_cast<value_type>(
+            ((rgba[i] & 0xf8) << 8) | ((rgba[i] >> 5) & 0x7e0) | ((rgba[i] >> 19) & 0x1f)
+        );
+    }
+}
+
+inline uint32_t detail::ColorRGB565::unpack_rgba8(value_type value)
+{
+    // replicate the top bits into the missing low ones so full intensity stays 0xff
+    const uint32_t r = value >> 11, g = (value >> 5) & 0x3f, b = value & 0x1f;
+    return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xff000000;
+}
+
+inline uint16_t detail::ColorRGBA16F::float_to_half(float value)
+{
+    // NOTE: same steps as pack4, round to nearest even on the 13 dropped mantissa bits
+    const float clamped = ::min(value > 0.0f ? value : 0.0f, 65504.0f);
+    uint32_t bits;
+    std::memcpy(&bits, &clamped, sizeof(bits));
+    if (bits < 0x38800000)
+        return 0;
+
+    bits += 0xfff + ((bits >> 13) & 1);
+    return static_cast<uint16_t>((bits >> 13) - ((127 - 15) << 10));
+}
+
+inline float detail::ColorRGBA16F::half_to_float(uint16_t value)
+{
+    // only ever holds normals and zero
+    if (!(value & 0x7c00))
+        return 0.0f;
+
+    const uint32_t bits = (static_cast<uint32_t>(value & 0x8000) << 16) | ((static_cast<uint32_t>(value & 0x7fff) << 13) + ((127 - 15) << 23));
+    float ret;
+    std::memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+
+inline void detail::ColorRGBA16F::pack4(const float (*colors)[4], value_type* out)
+{
+#ifdef HAS_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max = _mm_set1_ps(65504.0f);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i round = _mm_set1_epi32(0xfff);
+    const __m128i rebias = _mm_set1_epi32((127 - 15) << 10);
+    const __m128i min_normal = _mm_set1_epi32(0x38800000 - 1);
+
+    __m128i halfs[4];
+    for (int i = 0; i < 4; i++)
+    {
+        const __m128i bits = _mm_castps_si128(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(colors[i]), zero), max));
+        const __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(round, _mm_and_si128(_mm_srli_epi32(bits, 13), one)));
+        const __m128i half = _mm_sub_epi32(_mm_srli_epi32(rounded, 13), rebias);
+        halfs[i] = _mm_and_si128(half, _mm_cmpgt_epi32(bits, min_normal));
+    }
+
+    // halfs are at most 0x7bff, the signed saturation leaves them alone
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(halfs[0], halfs[1]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2), _mm_packs_epi32(halfs[2], halfs[3]));
+#else
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = 0;
+        for (int c = 0; c < 4; c++)
+            out[i] |= static_cast<value_type>(float_to_half(colors[i][c])) << (16 * c);
+    }
+#endif
+}
+
+inline void detail::ColorRGBA16F::pack4_rgba8(const uint32_t* rgba, value_type* out)
+{
+    float colors[4][4];
+    for (int i = 0; i < 4; i++)
+    {
+        for (int c = 0; c < 4; c++)
+            colors[i][c] = ((rgba[i] >> (8 * c)) & 0xff) * (1.0f / 255.0f);
+    }
+    pack4(colors, out);
+}
+
+inline uint32_t detail::ColorRGBA16F::unpack_rgba8(value_type value)
+{
+    uint32_t ret = 0;
+    for (int c = 0; c < 4; c++)
+        ret |= unorm_encode(half_to_float(static_cast<uint16_t>(value >> (16 * c))), 255.0f) << (8 * c);
+    return ret;
+}
+
+template <typename Func>
+inline void detail::dispatch_color_format(ColorBufferFormat format, Func&& fun)
+{
+    switch (format)
+    {
+        case ColorBufferFormat::ARGB8:
+            fun(ColorARGB8{});
+            return;
+
+        case ColorBufferFormat::xBGR8:
+            fun(ColorXBGR8{});
+            return;
+
+        case ColorBufferFormat::RGB565:
+            fun(ColorRGB565{});
+            return;
+
+        case ColorBufferFormat::RGBA16F:
+            fun(ColorRGBA16F{});
+            return;
+    }
+    throw std::runtime_error("unknown color buffer format");
+}
+
+inline uint32_t detail::rgba8_bilerp(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11, uint32_t fx, uint32_t fy)
+{
+    // NOTE: weights are (256 - f, f) so every channel product fits in 16bits
+#ifdef HAS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+
+    // 16bit lanes, [t00.rgba t10.rgba] and [t01.rgba t11.rgba]
+    const __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(t00), _mm_cvtsi32_si128(t10)), zero);
+    const __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(t01), _mm_cvtsi32_si128(t11)), zero);
+
+    // vertical pass on both columns at once
+    const __m128i column = _mm_srli_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(top, _mm_set1_epi16(static_cast<short>(256 - fy))),
+        _mm_mullo_epi16(bottom, _mm_set1_epi16(static_cast<short>(fy)))
+    ), 8);
+
+    // horizontal pass, right column is in the upper 4 lanes
+    const __m128i texel = _mm_srli_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(column, _mm_set1_epi16(static_cast<short>(256 - fx))),
+        _mm_mullo_epi16(_mm_srli_si128(column, 8), _mm_set1_epi16(static_cast<short>(fx)))
+    ), 8);
+
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(texel, zero)));
+#else
+    // 2 channels at a time in the 0x00ff00ff lanes of a dword
+    auto lerp = [](uint32_t a, uint32_t b, uint32_t f)
+    {
+        const uint32_t rb = ((((a & 0x00ff00ff) * (256 - f) + (b & 0x00ff00ff) * f) >> 8) & 0x00ff00ff);
+        const uint32_t ga = ((((a >> 8) & 0x00ff00ff) * (256 - f) + ((b >> 8) & 0x00ff00ff) * f) & 0xff00ff00);
+        return rb | ga;
+    };
+    return lerp(lerp(t00, t01, fy), lerp(t10, t11, fy), fx);
+#endif
 }
@@ -4,6 +4,7 @@
 
 #include "render_primitive.h"
 #include "software_buffers.h"
+#include "vertex_layout.h"
 
 using namespace std;
 
@@ -38,8 +39,489 @@ namespace
     {
         return 0;
     }
+
+    struct LightSum
+    {
+        Color ambient, diffuse, specular;
+    };
+
+    // adds a light contribution at a view-space point, the material colors are applied by the caller
+    // NOTE: with a specular table the fast math paths are used instead of sqrt/pow, the table
+    // itself only up to the exponents it stays accurate for
+    inline void add_light(
+        LightSum& sum, const Light& light, const vec3& light_pos,
+        const vec3& view_pos, const vec3& view_norm, float shininess, const PowTable* spec_table)
+    {
+        auto& atten_coef = light.get_attenuation();
+
+        const vec3 light_dir_denorm = light_pos - view_pos;
+        const float light_dist_sq = light_dir_denorm.length_sq();
+
+        // hard cutoff at the light range, clusters only guarantee a conservative fit
+        if (atten_coef[0] > 0 && light_dist_sq > atten_coef[0] * atten_coef[0])
+            return;
+
+        float light_dist;
+        vec3 light_dir;
+        if (spec_table)
+        {
+            const float light_dist_inv = fast_rsqrt(light_dist_sq);
+            light_dist = light_dist_sq * light_dist_inv;
+            light_dir = light_dir_denorm * light_dist_inv;
+        }
+        else
+        {
+            light_dist = sqrt(light_dist_sq);
+            light_dir = light_dir_denorm.normalize();
+        }
+
+        const float light_atten = 1.0f / (
+            atten_coef[1] +
+            atten_coef[2] * light_dist,
+            atten_coef[3] * light_dist * light_dist
+        );
+
+        // ambient color
+        sum.ambient += light.get_ambient() * light_atten;
+
+        // diffuse color
+        const float diff_coef = std::max(0.0f, view_norm * light_dir);
+        sum.diffuse += light.get_diffuse() * diff_coef * light_atten;
+
+        // specular color
+        if (diff_coef > 0)
+        {
+            const vec3 half_vec = spec_table ?
+                (light_dir - view_pos).normalize_fast() :
+                (light_dir - view_pos).normalize();
+            const float half_coef = std::max(0.0f, view_norm * half_vec);
+            const float spec_coef =
+                !spec_table ? pow(half_coef, shininess) :
+                shininess <= PowTable::MAX_EXPONENT ? (*spec_table)(half_coef) :
+                fast_pow(half_coef, shininess);
+            sum.specular += light.get_specular() * spec_coef * light_atten;
+        }
+    }
+
+    // point and wireframe color
+    const Color WIRE_COLOR = { 150 / 255.0f, 0.0f, 200 / 255.0f, 1.0f };
+
+    // NOTE: max device coordinate range the fixed-point rasterizer handles without overflow
+    constexpr float GUARD_BAND_SIZE = 2048.0f;
+
+    using detail::ClipVertex;
+
+    // convex polygon clipped plane by plane (sutherland-hodgman), starting from a triangle
+    class ClipPolygon
+    {
+    public:
+        // each plane adds at most one vertex, near plane + 4 guard band planes
+        static constexpr size_t MAX_VERTICES = 8;
+
+    public:
+        explicit ClipPolygon(const ClipVertex (&tri)[3]);
+        ~ClipPolygon() = default;
+
+        // keeps the part where dist(position) >= 0
+        template <typename Dist>
+        void clip(Dist dist);
+
+        size_t size() const;
+        const ClipVertex& operator[](size_t index) const;
+        const ClipVertex* begin() const;
+        const ClipVertex* end() const;
+
+    private:
+        static ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t);
+
+    private:
+        std::array<ClipVertex, MAX_VERTICES> m_vertices;
+        size_t m_count;
+    };
+
+    inline ClipPolygon::ClipPolygon(const ClipVertex (&tri)[3]) :
+        m_count(3)
+    {
+        std::copy(std::begin(tri), std::end(tri), m_vertices.begin());
+    }
+
+    template <typename Dist>
+    inline void ClipPolygon::clip(Dist dist)
+    {
+        std::array<float, MAX_VERTICES> d;
+        bool all_in = true;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            d[i] = dist(m_vertices[i].position);
+            all_in &= d[i] >= 0;
+        }
+
+        if (all_in)
+            return;
+
+        std::array<ClipVertex, MAX_VERTICES> out;
+        size_t out_count = 0;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            const size_t j = (i + 1) % m_count;
+            if (d[i] >= 0)
+                out[out_count++] = m_vertices[i];
+
+            // edge crosses the plane
+            if ((d[i] >= 0) != (d[j] >= 0) && out_count < MAX_VERTICES)
+                out[out_count++] = lerp(m_vertices[i], m_vertices[j], d[i] / (d[i] - d[j]));
+        }
+
+        m_vertices = out;
+        m_count = out_count;
+    }
+
+    inline size_t ClipPolygon::size() const
+    {
+        return m_count;
+    }
+
+    inline const ClipVertex& ClipPolygon::operator[](size_t index) const
+    {
+        return m_vertices[index];
+    }
+
+    inline const ClipVertex* ClipPolygon::begin() const
+    {
+        return m_vertices.data();
+    }
+
+    inline const ClipVertex* ClipPolygon::end() const
+    {
+        return m_vertices.data() + m_count;
+    }
+
+    inline ClipVertex ClipPolygon::lerp(const ClipVertex& a, const ClipVertex& b, float t)
+    {
+        return ClipVertex{
+            a.position + (b.position - a.position) * t,
+            a.view_position + (b.view_position - a.view_position) * t,
+            a.view_normal + (b.view_normal - a.view_normal) * t,
+            Color{ a.color + (b.color - a.color) * t },
+            a.texcoord + (b.texcoord - a.texcoord) * t
+        };
+    }
+
+    // varyings of a draw, per pixel work only covers the attributes that are there and get used
+    inline detail::VaryingLayout make_varying_layout(bool lighting, bool vertex_lighting, bool normals, bool colors, bool texcoords)
+    {
+        detail::VaryingLayout layout;
+        const auto add = [&](int& offset, size_t size)
+        {
+            offset = static_cast<int>(layout.count);
+            layout.count += size;
+        };
+
+        if (vertex_lighting)
+        {
+            add(layout.light_additive, 3);
+            add(layout.light_diffuse, 3);
+        }
+        else if (lighting)
+        {
+            add(layout.view_position, 3);
+            if (normals)
+                add(layout.view_normal, 3);
+        }
+
+        if (colors)
+            add(layout.color, 4);
+        if (texcoords)
+            add(layout.texcoord, 2);
+        return layout;
+    }
+
+    template <size_t N>
+    inline void store_varying(float* out, const vec<float, N>& value)
+    {
+        for (size_t i = 0; i < N; i++)
+            out[i] = value[i];
+    }
+
+    inline vec2 load_vec2(const float* in)
+    {
+        return vec2{ in[0], in[1] };
+    }
+
+    inline vec3 load_vec3(const float* in)
+    {
+        return vec3{ in[0], in[1], in[2] };
+    }
+
+    inline Color load_color(const float* in)
+    {
+        return Color{ in[0], in[1], in[2], in[3] };
+    }
+
+    // attribute fetch for the vertex types each semantic can use, the type is the same for a whole draw
+    // so the switches predict well; quantized positions come out in the [-1, 1] box
+    inline vec3 fetch_position(const uint8_t* ptr, VertexType type)
+    {
+        switch (type)
+        {
+            case VertexType::Short4N:
+            {
+                const int16_t* p = reinterpret_cast<const int16_t*>(ptr);
+                return vec3{ snorm16_decode(p[0]), snorm16_decode(p[1]), snorm16_decode(p[2]) };
+            }
+            default:
+            {
+                const float* p = reinterpret_cast<const float*>(ptr);
+                return vec3{ p[0], p[1], p[2] };
+            }
+        }
+    }
+
+    inline vec3 fetch_normal(const uint8_t* ptr, VertexType type)
+    {
+        switch (type)
+        {
+            case VertexType::Oct16:
+                return oct16_decode(reinterpret_cast<const int16_t*>(ptr));
+            default:
+            {
+                const float* p = reinterpret_cast<const float*>(ptr);
+                return vec3{ p[0], p[1], p[2] };
+            }
+        }
+    }
+
+    inline Color fetch_color(const uint8_t* ptr, VertexType type)
+    {
+        switch (type)
+        {
+            case VertexType::ColorU8:
+            {
+                uint32_t rgba;
+                std::memcpy(&rgba, ptr, sizeof(rgba));
+                return rgba8_decode(rgba);
+            }
+            default:
+            {
+                const float* p = reinterpret_cast<const float*>(ptr);
+                return Color{ p[0], p[1], p[2], p[3] };
+            }
+        }
+    }
+
+    inline vec2 fetch_texcoord(const uint8_t* ptr, VertexType type)
+    {
+        switch (type)
+        {
+            case VertexType::UShort2N:
+            {
+                const uint16_t* p = reinterpret_cast<const uint16_t*>(ptr);
+                return vec2{ unorm16_decode(p[0]), unorm16_decode(p[1]) };
+            }
+            default:
+            {
+                const float* p = reinterpret_cast<const float*>(ptr);
+                return vec2{ p[0], p[1] };
+            }
+        }
+    }
+
+    // vertex fetch thru the decl streams, any element types; works for every buffer
+    class RuntimeFetch
+    {
+    public:
+        explicit RuntimeFetch(const SoftwareVertexBuffer& vb);
+        ~RuntimeFetch() = default;
+
+        bool has_normals() const;
+        bool has_colors() const;
+        bool has_texcoords() const;
+
+        vec3 position(size_t index) const;
+        vec3 normal(size_t index) const;
+        Color color(size_t index) const;
+        vec2 texcoord(size_t index) const;
+
+    private:
+        SoftwareVertexBuffer::Stream m_position;
+        SoftwareVertexBuffer::Stream m_normal;
+        SoftwareVertexBuffer::Stream m_color;
+        SoftwareVertexBuffer::Stream m_texcoord;
+    };
+
+    inline RuntimeFetch::RuntimeFetch(const SoftwareVertexBuffer& vb) :
+        m_position(vb.get_stream(VertexSemantic::Position)),
+        m_normal(vb.get_stream(VertexSemantic::Normal)),
+        m_color(vb.get_stream(VertexSemantic::Color)),
+        m_texcoord(vb.get_stream(VertexSemantic::Texcoord))
+    {}
+
+    inline bool RuntimeFetch::has_normals() const
+    {
+        return m_normal.data != nullptr;
+    }
+
+    inline bool RuntimeFetch::has_colors() const
+    {
+        return m_color.data != nullptr;
+    }
+
+    inline bool RuntimeFetch::has_texcoords() const
+    {
+        return m_texcoord.data != nullptr;
+    }
+
+    inline vec3 RuntimeFetch::position(size_t index) const
+    {
+        return fetch_position(m_position.data + index * m_position.stride, m_position.type);
+    }
+
+    inline vec3 RuntimeFetch::normal(size_t index) const
+    {
+        return fetch_normal(m_normal.data + index * m_normal.stride, m_normal.type);
+    }
+
+    inline Color RuntimeFetch::color(size_t index) const
+    {
+        return fetch_color(m_color.data + index * m_color.stride, m_color.type);
+    }
+
+    inline vec2 RuntimeFetch::texcoord(size_t index) const
+    {
+        return fetch_texcoord(m_texcoord.data + index * m_texcoord.stride, m_texcoord.type);
+    }
+
+    // vertex fetch for a typed format, which attributes exist and how they decode are constants
+    template <typename V>
+    class TypedFetch
+    {
+    public:
+        explicit TypedFetch(const SoftwareVertexBuffer& vb);
+        ~TypedFetch() = default;
+
+        static constexpr bool has_normals();
+        static constexpr bool has_colors();
+        static constexpr bool has_texcoords();
+
+        vec3 position(size_t index) const;
+        vec3 normal(size_t index) const;
+        Color color(size_t index) const;
+        vec2 texcoord(size_t index) const;
+
+    private:
+        VertexView<V, const uint8_t*> m_view;
+    };
+
+    template <typename V>
+    inline TypedFetch<V>::TypedFetch(const SoftwareVertexBuffer& vb) :
+        m_view(vb.data(), vb)
+    {}
+
+    template <typename V>
+    inline constexpr bool TypedFetch<V>::has_normals()
+    {
+        return V::template has<VertexSemantic::Normal>();
+    }
+
+    template <typename V>
+    inline constexpr bool TypedFetch<V>::has_colors()
+    {
+        return V::template has<VertexSemantic::Color>();
+    }
+
+    template <typename V>
+    inline constexpr bool TypedFetch<V>::has_texcoords()
+    {
+        return V::template has<VertexSemantic::Texcoord>();
+    }
+
+    template <typename V>
+    inline vec3 TypedFetch<V>::position(size_t index) const
+    {
+        return m_view.template load<typename V::template find_t<VertexSemantic::Position, vec3>>(index);
+    }
+
+    template <typename V>
+    inline vec3 TypedFetch<V>::normal(size_t index) const
+    {
+        return m_view.template load<typename V::template find_t<VertexSemantic::Normal, vec3>>(index);
+    }
+
+    template <typename V>
+    inline Color TypedFetch<V>::color(size_t index) const
+    {
+        return m_view.template load<typename V::template find_t<VertexSemantic::Color, Color>>(index);
+    }
+
+    template <typename V>
+    inline vec2 TypedFetch<V>::texcoord(size_t index) const
+    {
+        return m_view.template load<typename V::template find_t<VertexSemantic::Texcoord, vec2>>(index);
+    }
+
+    // NOTE: meshlet bounds are in object space, so the frustum planes come straight from the mvp
+    // rows (gribb-hartmann) and the eye is moved into object space instead of transforming the bounds
+    class MeshletCuller
+    {
+    public:
+        MeshletCuller(const mat4& mvp_matrix, const mat4& mv_inv_matrix, const mat3& normal_matrix);
+        ~MeshletCuller() = default;
+
+        bool is_visible(const RenderMeshlet& meshlet) const;
+
+    private:
+        std::array<vec4, 6> m_planes;
+        vec3 m_eye;
+        bool m_cull_backfaces;
+    };
+
+    inline MeshletCuller::MeshletCuller(const mat4& mvp_matrix, const mat4& mv_inv_matrix, const mat3& normal_matrix)
+    {
+        const vec4 r0{ mvp_matrix[0] };
+        const vec4 r1{ mvp_matrix[1] };
+        const vec4 r2{ mvp_matrix[2] };
+        const vec4 r3{ mvp_matrix[3] };
+
+        // same planes as the clip-space triangle reject, near is z >= 0
+        m_planes = { r3 + r0, r3 - r0, r3 + r1, r3 - r1, r2, r3 - r2 };
+        for (auto& plane : m_planes)
+            plane *= 1.0f / vec3{ plane }.length();
+
+        m_eye = vec3{ mv_inv_matrix * vec4{ 0.0f, 0.0f, 0.0f, 1.0f } };
+
+        // mirroring transforms flip the winding, the per triangle test sees those as front-facing
+        const vec3 n0{ normal_matrix[0] };
+        const vec3 n1{ normal_matrix[1] };
+        const vec3 n2{ normal_matrix[2] };
+        m_cull_backfaces = n0 * (n1 ^ n2) > 0;
+    }
+
+    inline bool MeshletCuller::is_visible(const RenderMeshlet& meshlet) const
+    {
+        const vec4 center = vec4{ meshlet.center, 1.0f };
+        for (auto& plane : m_planes)
+        {
+            if (plane * center < -meshlet.radius)
+                return false;
+        }
+
+        if (!m_cull_backfaces || meshlet.cone_cos <= 0)
+            return true;
+
+        // back-facing when every normal in the cone points away from every direction from the eye into
+        // the sphere: angle(axis, center - eye) + cone angle + sphere half angle < 90 degrees
+        const vec3 dir = meshlet.center - m_eye;
+        const float dist_sq = dir.length_sq();
+        if (dist_sq <= meshlet.radius * meshlet.radius)
+            return true;
+
+        const float along = dir * meshlet.cone_axis;
+        const float across = sqrt(::max(dist_sq - along * along, 0.0f));
+        return along * meshlet.cone_cos - across * meshlet.cone_sin <= meshlet.radius;
+    }
 }
 
+
 ///////////////////////////////////////////////////////////////////////////////
 // Drawing methods
 ///////////////////////////////////////////////////////////////////////////////
@@ -49,55 +531,124 @@ SoftwareDevice::SoftwareDevice() :
     set_render_target(nullptr);
 }
 
-template <typename T> int sgn(T val)
-{
-    return (T(0) < val) - (val < T(0));
-}
-
 void SoftwareDevice::draw_primitive(const RenderPrimitive& primitive)
 {
-    const mat4& proj_matrix = m_params.get_proj_matrix();
-    const mat4& mv_matrix = m_params.get_mv_matrix();
-    const mat4& mvp_matrix = m_params.get_mvp_matrix();
-    const mat3& normal_matrix = m_params.get_normal_matrix();
-    const mat3x4& clip_matrix = m_params.get_clip_matrix();
-
     auto& vb = static_cast<const SoftwareVertexBuffer&>(primitive.vertices);
     auto& ib = static_cast<const SoftwareIndexBuffer&>(primitive.indices);
-
-    // go thru declaration and figure out the offsets and data size
-    int position_offset = -1;
-    int normal_offset = -1;
-    int color_offset = -1;
-    int texcoord_offset = -1;
-    for (auto& di : vb.get_declaration())
+    const VertexDecl& decl = vb.get_declaration();
+
+    // quantized positions get their scale/offset folded in the vertex transforms, identity otherwise
+    const vec3& pos_scale = vb.get_position_scale();
+    const vec3& pos_offset = vb.get_position_offset();
+    const mat4 dequant_matrix =
+        mat4::translate(pos_offset.x(), pos_offset.y(), pos_offset.z()) *
+        mat4::scale(pos_scale.x(), pos_scale.y(), pos_scale.z());
+
+    DrawState state;
+    state.mv_matrix = m_params.get_mv_matrix() * dequant_matrix;
+    state.mvp_matrix = m_params.get_mvp_matrix() * dequant_matrix;
+    state.normal_matrix = m_params.get_normal_matrix();
+    state.proj_matrix = m_params.get_proj_matrix();
+    state.clip_matrix = get_draw_clip_matrix();
+
+
+    // guard band, triangles inside it dont need x/y clipping since the bounding box gets clamped
+    // NOTE: device coordinates go thru fp4 edge functions with products in fp8, the band is sized so
+    // that the whole range stays within GUARD_BAND_SIZE pixels and those dont overflow
+    const float width = static_cast<float>(m_draw_target->get_width());
+    const float height = static_cast<float>(m_draw_target->get_height());
+    state.guard_x = 1.0f + 2.0f * clamp((GUARD_BAND_SIZE - width) * 0.5f, 0.0f, width) / ::max(width, 1.0f);
+    state.guard_y = 1.0f + 2.0f * clamp((GUARD_BAND_SIZE - height) * 0.5f, 0.0f, height) / ::max(height, 1.0f);
+
+    // whole meshlets outside the frustum or facing away get dropped before their vertices are touched
+    m_index_ranges.clear();
+    if (primitive.meshlets)
     {
-        switch (di.semantic)
+        const mat4 mv_inv_matrix = m_params.get_world_inv_matrix() * m_params.get_view_inv_matrix();
+        const MeshletCuller culler{ m_params.get_mvp_matrix(), mv_inv_matrix, state.normal_matrix };
+
+        for (auto& meshlet : *primitive.meshlets)
         {
-            case VertexSemantic::Position: position_offset = static_cast<int>(di.offset); break;
-            case VertexSemantic::Normal: normal_offset = static_cast<int>(di.offset); break;
-            case VertexSemantic::Color: color_offset = static_cast<int>(di.offset); break;
-            case VertexSemantic::Texcoord: texcoord_offset = static_cast<int>(di.offset); break;
+            if (!culler.is_visible(meshlet))
+                continue;
+
+            // adjacent visible meshlets get merged in a single range
+            const size_t first = meshlet.first_index;
+            const size_t last = first + meshlet.index_count;
+            if (!m_index_ranges.empty() && m_index_ranges.back().second == first)
+                m_index_ranges.back().second = last;
+            else
+                m_index_ranges.emplace_back(first, last);
         }
     }
-    size_t vertex_size = vb.get_declaration().get_vertex_size();
+    else
+        m_index_ranges.emplace_back(0, ib.get_count());
+
+    const bool gouraud = m_params.get_material_lighting() && m_params.get_material_shading_mode() == ShadingMode::Gouraud;
+    const bool fast_lighting = m_lighting_quality == LightingQuality::Fast;
+
+    const auto draw = [&](const auto& fetch)
+    {
+        state.has_normals = fetch.has_normals();
+        state.has_colors = fetch.has_colors();
+        state.has_texcoords = fetch.has_texcoords();
+        state.vertex_lighting = gouraud && state.has_normals;
+        state.spec_table = state.vertex_lighting && fast_lighting ? &m_params.get_material_specular_table() : nullptr;
+        state.varyings = make_varying_layout(
+            m_params.get_material_lighting(), state.vertex_lighting,
+            state.has_normals, state.has_colors, state.has_texcoords
+        );
+
+        switch (ib.get_format())
+        {
+            case IndexFormat::U16:
+                draw_indexed(reinterpret_cast<const uint16_t*>(ib.data()), fetch, state);
+                break;
 
-    // TODO: this will need to change when index size is != uint16_t
-    const uint16_t* ib_ptr = reinterpret_cast<const uint16_t*>(ib.data());
+            case IndexFormat::U32:
+                draw_indexed(reinterpret_cast<const uint32_t*>(ib.data()), fetch, state);
+                break;
+        }
+    };
+
+    // typed formats get their own vertex stage, anything else goes thru the decl streams
+    bool typed = false;
+    for_each_vertex_format<MeshVertexFormats>([&](auto format)
+    {
+        using V = decltype(format);
+        if (!typed && decl.get_format_id() == V::get_format_id())
+        {
+            draw(TypedFetch<V>{ vb });
+            typed = true;
+        }
+    });
+
+    if (!typed)
+        draw(RuntimeFetch{ vb });
+
+    draw_line_batch();
+    draw_point_batch();
+}
 
+template <typename Index, typename Fetch>
+void SoftwareDevice::draw_indexed(const Index* ib_ptr, const Fetch& fetch, const DrawState& state)
+{
     // TODO: performance, push these to display lists and parallel process
-    for (size_t i = 0; i < ib.get_count(); i += 3, ib_ptr += 3)
+    for (auto& range : m_index_ranges)
+    for (size_t i = range.first; i < range.second; i += 3)
     {
+        const Index* tri = ib_ptr + i;
+
         // TODO: cache transformed vertices with index as key
-        // vertex position computations
-        const float* p_p0 = reinterpret_cast<const float*>(vb.data() + position_offset + ib_ptr[0] * vertex_size);
-        const float* p_p1 = reinterpret_cast<const float*>(vb.data() + position_offset + ib_ptr[1] * vertex_size);
-        const float* p_p2 = reinterpret_cast<const float*>(vb.data() + position_offset + ib_ptr[2] * vertex_size);
+        // vertex position computations, only the position stream is touched for rejected triangles
+        const vec4 p0 = vec4{ fetch.position(tri[0]), 1.0f };
+        const vec4 p1 = vec4{ fetch.position(tri[1]), 1.0f };
+        const vec4 p2 = vec4{ fetch.position(tri[2]), 1.0f };
 
         // transform to view-space
-        const vec4 v0v = mv_matrix * vec4{ p_p0[0], p_p0[1], p_p0[2], 1.0f };
-        const vec4 v1v = mv_matrix * vec4{ p_p1[0], p_p1[1], p_p1[2], 1.0f };
-        const vec4 v2v = mv_matrix * vec4{ p_p2[0], p_p2[1], p_p2[2], 1.0f };
+        const vec4 v0v = state.mv_matrix * p0;
+        const vec4 v1v = state.mv_matrix * p1;
+        const vec4 v2v = state.mv_matrix * p2;
 
         const vec3 v0v_3 = vec3{ v0v };
         const vec3 v1v_3 = vec3{ v1v };
@@ -116,501 +667,1860 @@ void SoftwareDevice::draw_primitive(const RenderPrimitive& primitive)
         }
 
         // transform to clip-space
-        vec4 v0c = mvp_matrix * vec4{ p_p0[0], p_p0[1], p_p0[2], 1.0f };
-        vec4 v1c = mvp_matrix * vec4{ p_p1[0], p_p1[1], p_p1[2], 1.0f };
-        vec4 v2c = mvp_matrix * vec4{ p_p2[0], p_p2[1], p_p2[2], 1.0f };
-
-        // infinity transition when any vertices of the triangles are on +plane and the other on -plane
-        const int s0 = sgn(v0c.w());
-        const int s1 = sgn(v1c.w());
-        const int s2 = sgn(v2c.w());
-        if (!(s0 == s1 && s1 == s2))
+        ClipVertex cv[3];
+        cv[0].position = state.mvp_matrix * p0;
+        cv[1].position = state.mvp_matrix * p1;
+        cv[2].position = state.mvp_matrix * p2;
+
+        // frustrum culling in clip-space, all vertices outside the same plane
+        const auto outside = [&](auto dist)
+        {
+            return dist(cv[0].position) < 0 && dist(cv[1].position) < 0 && dist(cv[2].position) < 0;
+        };
+        if (outside([](const vec4& v) { return v.w() + v.x(); }) || outside([](const vec4& v) { return v.w() - v.x(); }) ||
+            outside([](const vec4& v) { return v.w() + v.y(); }) || outside([](const vec4& v) { return v.w() - v.y(); }) ||
+            outside([](const vec4& v) { return v.z(); }) || outside([](const vec4& v) { return v.w() - v.z(); }))
             continue;
 
-        const float wi0 = 1.0f / v0c.w();
-        const float wi1 = 1.0f / v1c.w();
-        const float wi2 = 1.0f / v2c.w();
+        cv[0].view_position = v0v_3;
+        cv[1].view_position = v1v_3;
+        cv[2].view_position = v2v_3;
 
-        // perspective division
-        v0c *= wi0;
-        v1c *= wi1;
-        v2c *= wi2;
+        if (fetch.has_normals())
+        {
+            cv[0].view_normal = state.normal_matrix * fetch.normal(tri[0]);
+            cv[1].view_normal = state.normal_matrix * fetch.normal(tri[1]);
+            cv[2].view_normal = state.normal_matrix * fetch.normal(tri[2]);
+        }
 
-        // frustrum culling - left, right view planes
-        if (v0c.x() < -1.0f && v1c.x() < -1.0f && v2c.x() < -1.0f)
-            continue;
-        if (v0c.x() > 1.0f && v1c.x() > 1.0f && v2c.x() > 1.0f)
-            continue;
+        if (fetch.has_colors())
+        {
+            cv[0].color = fetch.color(tri[0]);
+            cv[1].color = fetch.color(tri[1]);
+            cv[2].color = fetch.color(tri[2]);
+        }
 
-        // frustrum culling - top, down view planes
-        if (v0c.y() < -1.0f && v1c.y() < -1.0f && v2c.y() < -1.0f)
-            continue;
-        if (v0c.y() > 1.0f && v1c.y() > 1.0f && v2c.y() > 1.0f)
-            continue;
+        if (fetch.has_texcoords())
+        {
+            cv[0].texcoord = fetch.texcoord(tri[0]);
+            cv[1].texcoord = fetch.texcoord(tri[1]);
+            cv[2].texcoord = fetch.texcoord(tri[2]);
+        }
+
+        draw_clipped(cv, state);
+    }
+}
+
+void SoftwareDevice::draw_clipped(const ClipVertex (&cv)[3], const DrawState& state)
+{
+    // near plane is always clipped, w goes thru zero behind it; x/y only when leaving the guard band
+    ClipPolygon poly{ cv };
+    poly.clip([](const vec4& v) { return v.z(); });
+
+    const float guard_x = state.guard_x;
+    const float guard_y = state.guard_y;
+    const auto in_guard_band = [&](const vec4& v)
+    {
+        return std::abs(v.x()) <= guard_x * v.w() && std::abs(v.y()) <= guard_y * v.w();
+    };
+    if (!std::all_of(poly.begin(), poly.end(), [&](const ClipVertex& v) { return in_guard_band(v.position); }))
+    {
+        poly.clip([&](const vec4& v) { return guard_x * v.w() + v.x(); });
+        poly.clip([&](const vec4& v) { return guard_x * v.w() - v.x(); });
+        poly.clip([&](const vec4& v) { return guard_y * v.w() + v.y(); });
+        poly.clip([&](const vec4& v) { return guard_y * v.w() - v.y(); });
+    }
+
+    if (poly.size() < 3)
+        return;
+
+    const detail::VaryingLayout& layout = state.varyings;
+    std::array<DevicePoint, ClipPolygon::MAX_VERTICES> dp;
+    for (size_t k = 0; k < poly.size(); k++)
+    {
+        const ClipVertex& v = poly[k];
+        const float wi = 1.0f / v.position.w();
+
+        // perspective division and transform to device space
+        const vec4 vc = v.position * wi;
+        const vec3 vd = state.clip_matrix * vc;
+
+        dp[k].position = vec4{ vd.x(), vd.y(), vc.z(), wi };
+
+        float* out = dp[k].varyings.data();
+        if (layout.view_position >= 0)
+            store_varying(out + layout.view_position, v.view_position * wi);
+        if (layout.view_normal >= 0)
+            store_varying(out + layout.view_normal, v.view_normal * wi);
+        if (layout.color >= 0)
+            store_varying(out + layout.color, v.color * wi);
+        if (layout.texcoord >= 0)
+            store_varying(out + layout.texcoord, v.texcoord * wi);
+    }
+
+    if (state.vertex_lighting)
+    {
+        // gouraud shading, whole lighting equation per vertex
+        const Color& mat_ambient = m_params.get_material_ambient();
+        const Color& mat_specular = m_params.get_material_specular();
+        const Color& mat_emissive = m_params.get_material_emissive();
+        const float mat_shininess = m_params.get_material_shininess();
+
+        for (size_t k = 0; k < poly.size(); k++)
+        {
+            const vec3& view_pos = poly[k].view_position;
+            const vec3 view_norm = state.spec_table ?
+                poly[k].view_normal.normalize_fast() :
+                poly[k].view_normal.normalize();
+
+            // NOTE: vertices can be off-screen, so these go thru all the lights instead of the clusters
+            LightSum sum;
+            for (size_t l = 0; l < m_light_clusters.get_light_count(); l++)
+            {
+                const vec3& light_pos = m_light_clusters.get_view_position(l);
+                add_light(sum, m_light_clusters.get_light(l), light_pos, view_pos, view_norm, mat_shininess, state.spec_table);
+            }
+
+            const Color additive = mat_ambient % sum.ambient + mat_specular % sum.specular + mat_emissive;
+            float* out = dp[k].varyings.data();
+            store_varying(out + layout.light_diffuse, vec3{ sum.diffuse } * dp[k].position.w());
+            store_varying(out + layout.light_additive, vec3{ additive } * dp[k].position.w());
+        }
+    }
+
+    if (m_debug_normals)
+    {
+        for (size_t k = 0; k < poly.size(); k++)
+        {
+            // compute screen-space (vertex + normal)
+            vec3 v_dn = poly[k].view_position + poly[k].view_normal.normalize() * 0.5f;
+            vec4 v_dnc = state.proj_matrix * vec4{ v_dn, 1.0f };
+            v_dnc *= 1.0f / v_dnc.w();
+            vec3 v_dnd = state.clip_matrix * v_dnc;
+
+            m_line_batch.push_back(dp[k].position);
+            m_line_batch.push_back(vec4{ v_dnd.x(), v_dnd.y(), 0, 0 });
+        }
+    }
+
+    switch (m_poly_mode)
+    {
+        case PolygonMode::Point:
+            for (size_t k = 0; k < poly.size(); k++)
+                m_point_batch.push_back(dp[k].position);
+            break;
+
+        // NOTE: only the outline, the fan diagonals arent edges of the original triangle
+        case PolygonMode::Line:
+            for (size_t k = 0; k < poly.size(); k++)
+            {
+                m_line_batch.push_back(dp[k].position);
+                m_line_batch.push_back(dp[(k + 1) % poly.size()].position);
+            }
+            break;
+
+        // clipped polygon is convex, fan it out
+        case PolygonMode::Fill:
+            for (size_t k = 2; k < poly.size(); k++)
+                draw_tri(dp[0], dp[k - 1], dp[k], layout);
+            break;
+    }
+}
+
+void SoftwareDevice::draw_tri(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2, const detail::VaryingLayout& varyings)
+{
+    if (m_raster_mode == RasterMode::SpanBuffer)
+        defer_fill(p0, p1, p2, varyings);
+    else
+        draw_fill(p0, p1, p2, varyings, get_specular_table(), false);
+}
+
+void SoftwareDevice::defer_fill(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2, const detail::VaryingLayout& varyings)
+{
+    // NOTE: state only changes between primitives, so most triangles share the last snapshot
+    const Material* material = m_params.get_material();
+    if (m_deferred_states.empty() ||
+        m_deferred_states.back().material != material ||
+        m_deferred_states.back().texture_units != m_texture_units ||
+        m_deferred_states.back().varyings != varyings)
+    {
+        const PowTable* spec_table = get_specular_table();
+        m_deferred_states.push_back({
+            material, m_texture_units, spec_table ? *spec_table : PowTable{}, spec_table != nullptr, varyings
+        });
+    }
+
+    const float depth = ::min(p0.position.z(), p1.position.z(), p2.position.z());
+    m_deferred_tris.push_back({ { p0, p1, p2 }, m_deferred_states.size() - 1, depth });
+}
+
+void SoftwareDevice::flush()
+{
+    draw_deferred();
+    resolve_intermediate();
+    update_resolution();
+}
+
+void SoftwareDevice::draw_deferred()
+{
+    if (m_deferred_tris.empty())
+        return;
+
+    // front to back by nearest vertex, ties keep the submission order
+    m_deferred_order.resize(m_deferred_tris.size());
+    std::iota(m_deferred_order.begin(), m_deferred_order.end(), 0);
+    std::stable_sort(
+        m_deferred_order.begin(), m_deferred_order.end(),
+        [this](size_t a, size_t b) { return m_deferred_tris[a].depth < m_deferred_tris[b].depth; }
+    );
+
+    m_covered_spans.resize(m_draw_target->get_height());
+    for (auto& row : m_covered_spans)
+        row.clear();
+
+    // the deferred states replace the current ones only while drawing
+    const Material* material = m_params.get_material();
+    const auto texture_units = m_texture_units;
+
+    size_t state_index = m_deferred_states.size();
+    for (size_t index : m_deferred_order)
+    {
+        const DeferredTri& tri = m_deferred_tris[index];
+        const DeferredState& state = m_deferred_states[tri.state];
+        if (tri.state != state_index)
+        {
+            state_index = tri.state;
+            if (state.material)
+                m_params.set_material(*state.material);
+            m_texture_units = state.texture_units;
+        }
+
+        draw_fill(
+            tri.points[0], tri.points[1], tri.points[2], state.varyings,
+            state.has_specular_table ? &state.specular_table : nullptr, true
+        );
+    }
+
+    if (material)
+        m_params.set_material(*material);
+    m_texture_units = texture_units;
+
+    m_deferred_tris.clear();
+    m_deferred_states.clear();
+}
+
+namespace
+{
+    class lerp_halfedge
+    {
+        using fp4v = vec<fp4, 3>;
+        using fp8v = vec<fp8, 3>;
+
+    public:
+        lerp_halfedge(const fp4v& x, const fp4v& y, fp4 x0, fp4 y0) :
+            // deltas in fp4
+            dx4{ x[0] - x[1], x[1] - x[2], x[2] - x[0] },
+            dy4{ y[0] - y[1], y[1] - y[2], y[2] - y[0] },
+
+            // constant part of half-edge functions + fill correction (left sides are filled on +1, right sides are not)
+            const8 {
+                dy4[0].denorm_mul(x[0]) - dx4[0].denorm_mul(y[0]) + (dy4[0] < 0 || (dy4[0] == 0 && dx4[0] > 0)),
+                dy4[1].denorm_mul(x[1]) - dx4[1].denorm_mul(y[1]) + (dy4[1] < 0 || (dy4[1] == 0 && dx4[1] > 0)),
+                dy4[2].denorm_mul(x[2]) - dx4[2].denorm_mul(y[2]) + (dy4[2] < 0 || (dy4[2] == 0 && dx4[2] > 0))
+            },
+
+            // running half-edge values, all in fixed-point 8 frac digits
+            value_y {
+                const8[0] + dx4[0].denorm_mul(y0) - dy4[0].denorm_mul(x0),
+                const8[1] + dx4[1].denorm_mul(y0) - dy4[1].denorm_mul(x0),
+                const8[2] + dx4[2].denorm_mul(y0) - dy4[2].denorm_mul(x0)
+            },
+            value_x{ 0, 0, 0 },
+            dx{ dx4[0], dx4[1], dx4[2] },
+            dy{ dy4[0], dy4[1], dy4[2] },
+
+            // deltas in float
+            fdx{ static_cast<float>(dx4[0]), static_cast<float>(dx4[1]), static_cast<float>(dx4[2]) },
+            fdy{ static_cast<float>(dy4[0]), static_cast<float>(dy4[1]), static_cast<float>(dy4[2]) },
+
+            // interpolation normalization
+            lerp_norm{ 1.0f / (fdx[0] * fdy[2] - fdx[2] * fdy[0]) },
+
+            // weights for 0,1,2 lerp dot products
+            weight {
+                static_cast<float>(value_y[1]) * lerp_norm,
+                static_cast<float>(value_y[2]) * lerp_norm,
+                static_cast<float>(value_y[0]) * lerp_norm
+            },
+            weight_dx { fdx[1] * lerp_norm, fdx[2] * lerp_norm, fdx[0] * lerp_norm },
+            weight_dy { fdy[1] * lerp_norm, fdy[2] * lerp_norm, fdy[0] * lerp_norm }
+        {
+            // first iteration values
+            value_x = value_y;
+        }
+        ~lerp_halfedge() = default;
+
+    public:
+        const fp8v& value() const
+        {
+            return value_x;
+        }
+
+        const vec3& w() const
+        {
+            return weight;
+        }
+
+        const vec3& w_dx() const
+        {
+            return weight_dx;
+        }
+
+        const vec3& w_dy() const
+        {
+            return weight_dy;
+        }
+
+        void incr_y()
+        {
+            value_y += dx;
+            value_x = value_y;
+        }
+
+        void incr_x()
+        {
+            value_x -= dy;
+        }
+
+        void incr_x(int count)
+        {
+            const FixedPoint<int32_t, 0> n{ count };
+            value_x -= fp8v{ dy4[0].denorm_mul(n), dy4[1].denorm_mul(n), dy4[2].denorm_mul(n) };
+        }
+
+    private:
+        // NOTE: these need to be places here in order for init to work correctly
+        const fp4v dx4, dy4;
+        const fp8v const8;
+        const vec3 fdx, fdy;
+        const float lerp_norm;
+
+        fp8v value_x, value_y;
+        const fp8v dx, dy;
+
+        // weights
+        const vec3 weight;
+        const vec3 weight_dx;
+        const vec3 weight_dy;
+    };
+
+    // interpolated block layout: 1/w and then the DevicePoint varyings, depth comes from the triangle plane
+    constexpr size_t LERP_W = 0;
+    constexpr size_t LERP_VARYINGS = 1;
+    constexpr size_t LERP_BLOCK_SIZE = LERP_VARYINGS + detail::MAX_VARYINGS;
+
+    using lerp_values = std::array<float, LERP_BLOCK_SIZE>;
+
+    // floats interpolated together over the triangle, only the first count of the block get stepped
+    class lerp_block
+    {
+    public:
+        lerp_block(const lerp_halfedge& he, const lerp_values (&attrs)[3], size_t count) :
+            m_count{ count }
+        {
+            for (size_t i = 0; i < m_count; i++)
+            {
+                m_value_y[i] = attrs[0][i] * he.w()[0] + attrs[1][i] * he.w()[1] + attrs[2][i] * he.w()[2];
+                m_dx[i] = attrs[0][i] * he.w_dx()[0] + attrs[1][i] * he.w_dx()[1] + attrs[2][i] * he.w_dx()[2];
+                m_dy[i] = attrs[0][i] * he.w_dy()[0] + attrs[1][i] * he.w_dy()[1] + attrs[2][i] * he.w_dy()[2];
+            }
+
+            // first iteration values
+            m_value_x = m_value_y;
+        }
+        ~lerp_block() = default;
+
+        size_t count() const
+        {
+            return m_count;
+        }
+
+        float value(size_t index) const
+        {
+            return m_value_x[index];
+        }
+
+        // value count pixels further on the current row
+        float value_at(size_t index, int count) const
+        {
+            return m_value_x[index] - m_dy[index] * static_cast<float>(count);
+        }
+
+        void incr_y()
+        {
+            for (size_t i = 0; i < m_count; i++)
+            {
+                m_value_y[i] += m_dx[i];
+                m_value_x[i] = m_value_y[i];
+            }
+        }
+
+        void incr_x()
+        {
+            for (size_t i = 0; i < m_count; i++)
+                m_value_x[i] -= m_dy[i];
+        }
+
+        void incr_x(int count)
+        {
+            const float n = static_cast<float>(count);
+            for (size_t i = 0; i < m_count; i++)
+                m_value_x[i] -= m_dy[i] * n;
+        }
+
+    private:
+        const size_t m_count;
+        lerp_values m_value_x, m_value_y;
+        lerp_values m_dx, m_dy;
+    };
+
+    // perspective correct block at the ends of a span, affine stepping in between
+    class lerp_span
+    {
+    public:
+        static constexpr size_t FIXED_COUNT = 4;
+
+    public:
+        lerp_span() = default;
+        ~lerp_span() = default;
+
+        // starts a span at the current position of attrs and moves them past it,
+        // returns the actual length since spans leaving the triangle plane fall back to 1
+        int begin(lerp_block& attrs, int length)
+        {
+            m_count = attrs.count();
+            const float w0 = 1.0f / attrs.value(LERP_W);
+            const float wi1 = attrs.value_at(LERP_W, length);
+
+            if (length == 1 || wi1 <= 0)
+            {
+                for (size_t i = 0; i < m_count; i++)
+                    m_value[i] = attrs.value(i) * w0;
+                begin_fixed(false);
+
+                attrs.incr_x();
+                return 1;
+            }
+
+            const float w1 = 1.0f / wi1;
+            const float norm = 1.0f / length;
+            for (size_t i = 0; i < m_count; i++)
+            {
+                m_value[i] = attrs.value(i) * w0;
+                m_step[i] = (attrs.value_at(i, length) * w1 - m_value[i]) * norm;
+            }
+            begin_fixed(true);
+
+            attrs.incr_x(length);
+            return length;
+        }
+
+        void incr_x()
+        {
+            for (size_t i = 0; i < m_count; i++)
+                m_value[i] += m_step[i];
+            for (size_t i = 0; i < m_fixed_count; i++)
+                m_fixed_value[i] += m_fixed_step[i];
+        }
+
+        // single perspective correct sample from the triangle weights, nothing to step over after
+        void sample(const vec3& weights, const lerp_values (&attrs)[3], size_t count)
+        {
+            m_count = count;
+            for (size_t i = 0; i < m_count; i++)
+                m_value[i] = attrs[0][i] * weights[0] + attrs[1][i] * weights[1] + attrs[2][i] * weights[2];
+
+            const float w = 1.0f / m_value[LERP_W];
+            for (size_t i = 0; i < m_count; i++)
+                m_value[i] *= w;
+            begin_fixed(false);
+        }
+
+        // NOTE: up to FIXED_COUNT values also get stepped as 24.8 fixed point of value * scale
+        // with integer adds, these stay linear between the perspective correct span ends
+        void add_fixed(size_t index, float scale)
+        {
+            m_fixed_index[m_fixed_count] = index;
+            m_fixed_scale[m_fixed_count] = scale;
+            m_fixed_count++;
+        }
+
+        int32_t get_fixed(size_t index) const
+        {
+            return m_fixed_value[index];
+        }
+
+        float get(size_t index) const
+        {
+            return m_value[index];
+        }
+
+        // varyings of the current pixel, packed as in the DevicePoint
+        const float* varyings() const
+        {
+            return m_value.data() + LERP_VARYINGS;
+        }
+
+    private:
+        void begin_fixed(bool step)
+        {
+            for (size_t i = 0; i < m_fixed_count; i++)
+            {
+                const float scale = m_fixed_scale[i] * 256.0f;
+                m_fixed_value[i] = static_cast<int32_t>(std::floor(m_value[m_fixed_index[i]] * scale));
+                m_fixed_step[i] = step ? static_cast<int32_t>(std::lrint(m_step[m_fixed_index[i]] * scale)) : 0;
+            }
+        }
+
+    private:
+        size_t m_count = 0;
+        lerp_values m_value = {};
+        lerp_values m_step = {};
+
+        size_t m_fixed_count = 0;
+        std::array<size_t, FIXED_COUNT> m_fixed_index = {};
+        std::array<float, FIXED_COUNT> m_fixed_scale = {};
+        std::array<int32_t, FIXED_COUNT> m_fixed_value = {}, m_fixed_step = {};
+    };
+
+    // NOTE: triangles whose w varies less than these ratios between vertices get
+    // perspective correction every that many pixels, the rest is exact per pixel
+    constexpr float SPAN_LONG_MAX_RATIO = 1.25f;
+    constexpr int SPAN_LONG_LENGTH = 16;
+    constexpr float SPAN_SHORT_MAX_RATIO = 2.0f;
+    constexpr int SPAN_SHORT_LENGTH = 8;
+
+    // bounding box size in pixels up to which triangles skip the interpolator setup
+    constexpr int SMALL_TRI_SIZE = 2;
+
+    // half-edge test of a single pixel with the same fill convention as lerp_halfedge, the
+    // edge values come back normalized as the triangle weights for that pixel
+    inline bool halfedge_test(const vec<fp4, 3>& x, const vec<fp4, 3>& y, int px, int py, vec3& weights)
+    {
+        const fp4 x0 = px, y0 = py;
+
+        fp8 edges[3] = { 0, 0, 0 };
+        for (size_t i = 0; i < 3; i++)
+        {
+            const size_t j = (i + 1) % 3;
+            const fp4 dx4 = x[i] - x[j];
+            const fp4 dy4 = y[i] - y[j];
+            edges[i] =
+                dy4.denorm_mul(x[i]) - dx4.denorm_mul(y[i]) + (dy4 < 0 || (dy4 == 0 && dx4 > 0)) +
+                dx4.denorm_mul(y0) - dy4.denorm_mul(x0);
+
+            if (!(edges[i] > 0))
+                return false;
+        }
+
+        const float fdx0 = static_cast<float>(x[0] - x[1]), fdy0 = static_cast<float>(y[0] - y[1]);
+        const float fdx2 = static_cast<float>(x[2] - x[0]), fdy2 = static_cast<float>(y[2] - y[0]);
+        const float norm = 1.0f / (fdx0 * fdy2 - fdx2 * fdy0);
+        weights = vec3{
+            static_cast<float>(edges[1]) * norm,
+            static_cast<float>(edges[2]) * norm,
+            static_cast<float>(edges[0]) * norm
+        };
+        return true;
+    }
+
+    inline uint32_t pack_rgba8(const Color& color)
+    {
+        return
+            detail::unorm_encode(color.r(), 255.0f) |
+            (detail::unorm_encode(color.g(), 255.0f) << 8) |
+            (detail::unorm_encode(color.b(), 255.0f) << 16) |
+            (detail::unorm_encode(color.a(), 255.0f) << 24);
+    }
+
+    // stores of a 4 pixel group from x on in one color format, only the pixels in mask get written;
+    // picked once per draw so the fragments never switch on the format
+    struct ColorWriter
+    {
+        void (*store_colors)(uint8_t* row, int x, const float (*colors)[4], uint32_t mask);
+        void (*store_rgba8)(uint8_t* row, int x, const uint32_t* rgba, uint32_t mask);
+    };
+
+    template <typename Format>
+    inline void store_group(typename Format::value_type* dst, const typename Format::value_type* packed, uint32_t mask)
+    {
+        if (mask == 0xf)
+        {
+            std::copy_n(packed, 4, dst);
+            return;
+        }
+
+        for (int i = 0; i < 4; i++)
+        {
+            if (mask & (1u << i))
+                dst[i] = packed[i];
+        }
+    }
+
+    template <typename Format>
+    void store_colors(uint8_t* row, int x, const float (*colors)[4], uint32_t mask)
+    {
+        typename Format::value_type packed[4];
+        Format::pack4(colors, packed);
+        store_group<Format>(reinterpret_cast<typename Format::value_type*>(row) + x, packed, mask);
+    }
+
+    template <typename Format>
+    void store_rgba8(uint8_t* row, int x, const uint32_t* rgba, uint32_t mask)
+    {
+        typename Format::value_type packed[4];
+        Format::pack4_rgba8(rgba, packed);
+        store_group<Format>(reinterpret_cast<typename Format::value_type*>(row) + x, packed, mask);
+    }
+
+    inline ColorWriter get_color_writer(ColorBufferFormat format)
+    {
+        ColorWriter ret;
+        detail::dispatch_color_format(format, [&](auto traits)
+        {
+            using Format = decltype(traits);
+            ret = ColorWriter{ &store_colors<Format>, &store_rgba8<Format> };
+        });
+        return ret;
+    }
+
+    // clips the segment to [0, max_x] x [0, max_y] (liang-barsky), z follows along
+    inline bool clip_line(vec4& a, vec4& b, float max_x, float max_y)
+    {
+        const vec4 d = b - a;
+        const float p[4] = { -d.x(), d.x(), -d.y(), d.y() };
+        const float q[4] = { a.x(), max_x - a.x(), a.y(), max_y - a.y() };
+
+        float t0 = 0.0f, t1 = 1.0f;
+        for (int i = 0; i < 4; i++)
+        {
+            if (p[i] == 0)
+            {
+                // parallel to this edge
+                if (q[i] < 0)
+                    return false;
+                continue;
+            }
+
+            const float t = q[i] / p[i];
+            if (p[i] < 0)
+                t0 = std::max(t0, t);
+            else
+                t1 = std::min(t1, t);
+        }
+
+        if (t0 > t1)
+            return false;
+
+        b = a + d * t1;
+        a = a + d * t0;
+        return true;
+    }
+
+    // zeroes size bytes with non-temporal stores where aligned, for bulk clears nothing reads back soon
+    inline void clear_stream(uint8_t* dst, size_t size)
+    {
+#ifdef HAS_SSE2
+        const size_t head = ::min((16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15, size);
+        std::memset(dst, 0, head);
+
+        size_t i = head;
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), zero);
+
+        std::memset(dst + i, 0, size - i);
+#else
+        std::memset(dst, 0, size);
+#endif
+    }
+
+    // copies color and depth between targets of the same size and formats, row by row since strides differ
+    inline void copy_target(RenderTarget& src, RenderTarget& dst)
+    {
+        auto& src_color = src.get_color_buffer();
+        auto& dst_color = dst.get_color_buffer();
+        const size_t color_elem_size = ColorBuffer::get_elem_size(src_color.get_format());
+        const size_t src_color_pitch = src_color.get_stride() * color_elem_size;
+        const size_t dst_color_pitch = dst_color.get_stride() * color_elem_size;
+
+        auto& src_depth = src.get_depth_buffer();
+        auto& dst_depth = dst.get_depth_buffer();
+        const size_t depth_elem_size = DepthBuffer::get_elem_size(src_depth.get_format());
+        const size_t src_depth_pitch = src_depth.get_stride() * depth_elem_size;
+        const size_t dst_depth_pitch = dst_depth.get_stride() * depth_elem_size;
+
+        const uint8_t* src_color_data = src_color.lock();
+        uint8_t* dst_color_data = dst_color.lock();
+        const uint8_t* src_depth_data = src_depth.lock();
+        uint8_t* dst_depth_data = dst_depth.lock();
+
+        const int width = src.get_width();
+        for (int y = 0; y < src.get_height(); y++)
+        {
+            std::memcpy(dst_color_data + y * dst_color_pitch, src_color_data + y * src_color_pitch, width * color_elem_size);
+            std::memcpy(dst_depth_data + y * dst_depth_pitch, src_depth_data + y * src_depth_pitch, width * depth_elem_size);
+        }
+
+        dst_depth.unlock();
+        src_depth.unlock();
+        dst_color.unlock();
+        src_color.unlock();
+    }
+
+    // pixels [x0, x1) x [y0, y1) a point or line batch can touch, clamped before the int conversion
+    inline void batch_bounds(const std::vector<vec4>& batch, int& x0, int& y0, int& x1, int& y1)
+    {
+        float lo_x = std::numeric_limits<float>::max(), lo_y = lo_x;
+        float hi_x = std::numeric_limits<float>::lowest(), hi_y = hi_x;
+        for (const vec4& p : batch)
+        {
+            lo_x = ::min(lo_x, p.x());
+            lo_y = ::min(lo_y, p.y());
+            hi_x = ::max(hi_x, p.x());
+            hi_y = ::max(hi_y, p.y());
+        }
+
+        constexpr float limit = 1 << 24;
+        x0 = static_cast<int>(std::floor(clamp(lo_x, -limit, limit)));
+        y0 = static_cast<int>(std::floor(clamp(lo_y, -limit, limit)));
+        x1 = static_cast<int>(std::ceil(clamp(hi_x, -limit, limit))) + 1;
+        y1 = static_cast<int>(std::ceil(clamp(hi_y, -limit, limit))) + 1;
+    }
+
+    // NOTE: device z is affine in screen-space, so the plane through the 3 device points gives the exact
+    // depth at any pixel; degenerate triangles have no pixels, they get the nearest z to be safe
+    inline detail::DepthPlane make_depth_plane(const vec4& p0, const vec4& p1, const vec4& p2)
+    {
+        const float dx1 = p1.x() - p0.x(), dy1 = p1.y() - p0.y(), dz1 = p1.z() - p0.z();
+        const float dx2 = p2.x() - p0.x(), dy2 = p2.y() - p0.y(), dz2 = p2.z() - p0.z();
+
+        const float det = dx1 * dy2 - dx2 * dy1;
+        if (det == 0)
+            return detail::DepthPlane{ ::min(p0.z(), p1.z(), p2.z()), 0.0f, 0.0f };
+
+        const float b = (dz1 * dy2 - dz2 * dy1) / det;
+        const float c = (dx1 * dz2 - dx2 * dz1) / det;
+        return detail::DepthPlane{ p0.z() - b * p0.x() - c * p0.y(), b, c };
+    }
+
+    // plane z at the start of row y, then at pixel x of that row; every depth path evaluates it
+    // the same way so the scalar, SIMD and expanded plane tiles store the very same values
+    inline float plane_row_z(const detail::DepthPlane& plane, int y)
+    {
+        return plane.a + plane.c * static_cast<float>(y);
+    }
+
+    inline float plane_z(const detail::DepthPlane& plane, float row_z, int x)
+    {
+        return row_z + plane.b * static_cast<float>(x);
+    }
+
+    inline bool same_plane(const detail::DepthPlane& a, const detail::DepthPlane& b)
+    {
+        return a.a == b.a && a.b == b.b && a.c == b.c;
+    }
+
+    // whether pixel x of row y is already covered by a triangle not farther than z
+    inline bool span_hides(const std::vector<detail::ScanlineSpan>& spans, int x, int y, float z)
+    {
+        auto it = std::lower_bound(
+            spans.begin(), spans.end(), x,
+            [](const detail::ScanlineSpan& span, int x) { return span.x1 <= x; }
+        );
+        return it != spans.end() && it->x0 <= x && !(z < plane_z(it->plane, plane_row_z(it->plane, y), x));
+    }
+
+    // appends the parts of [x0, x1) in row y where the plane is nearer than the covered spans
+    inline void find_visible_spans(
+        const std::vector<detail::ScanlineSpan>& spans, int x0, int x1, int y,
+        const detail::DepthPlane& plane, std::vector<detail::ScanlineSpan>& visible
+    )
+    {
+        auto push = [&](int from, int to)
+        {
+            if (from >= to)
+                return;
+            if (!visible.empty() && visible.back().x1 == from)
+                visible.back().x1 = to;
+            else
+                visible.push_back(detail::ScanlineSpan{ from, to, plane });
+        };
+
+        const float row_z = plane_row_z(plane, y);
+        auto it = std::lower_bound(
+            spans.begin(), spans.end(), x0,
+            [](const detail::ScanlineSpan& span, int x) { return span.x1 <= x; }
+        );
+
+        int x = x0;
+        for (; it != spans.end() && it->x0 < x1; ++it)
+        {
+            push(x, it->x0);
+
+            // the depth difference is linear along the row, d0 + dd * x, visible where negative
+            const int from = ::max(x, it->x0), to = ::min(x1, it->x1);
+            const float d0 = row_z - plane_row_z(it->plane, y);
+            const float dd = plane.b - it->plane.b;
+            if (dd == 0)
+            {
+                if (d0 < 0)
+                    push(from, to);
+            }
+            else
+            {
+                const float root = ::clamp(-d0 / dd, static_cast<float>(from - 1), static_cast<float>(to));
+                if (dd > 0)
+                    push(from, static_cast<int>(std::ceil(root)));
+                else
+                    push(static_cast<int>(std::floor(root)) + 1, to);
+            }
+            x = to;
+        }
+        push(x, x1);
+    }
+
+    // overwrites [x0, x1) of a sorted list of disjoint spans, the plane goes along
+    inline void insert_span(std::vector<detail::ScanlineSpan>& spans, int x0, int x1, const detail::DepthPlane& plane)
+    {
+        // first span touching or after the new one
+        auto first = std::lower_bound(
+            spans.begin(), spans.end(), x0,
+            [](const detail::ScanlineSpan& span, int x) { return span.x1 < x; }
+        );
+
+        // whatever sticks out of the new span stays, touching ones of the same triangle merge
+        detail::ScanlineSpan span{ x0, x1, plane };
+        detail::ScanlineSpan left{ 0, 0, plane }, right{ 0, 0, plane };
+        auto last = first;
+        for (; last != spans.end() && last->x0 <= x1; ++last)
+        {
+            if (same_plane(last->plane, plane))
+            {
+                span.x0 = ::min(span.x0, last->x0);
+                span.x1 = ::max(span.x1, last->x1);
+                continue;
+            }
+            if (last->x0 < x0)
+                left = detail::ScanlineSpan{ last->x0, x0, last->plane };
+            if (last->x1 > x1)
+                right = detail::ScanlineSpan{ x1, last->x1, last->plane };
+        }
+
+        detail::ScanlineSpan pieces[3];
+        size_t count = 0;
+        if (left.x0 < left.x1)
+            pieces[count++] = left;
+        pieces[count++] = span;
+        if (right.x0 < right.x1)
+            pieces[count++] = right;
+
+        const auto at = first - spans.begin();
+        const size_t replaced = static_cast<size_t>(last - first);
+        if (replaced < count)
+            spans.insert(last, count - replaced, span);
+        else
+            spans.erase(first + count, last);
+        std::copy_n(pieces, count, spans.begin() + at);
+    }
+
+    // less-than test of the 4 pixels from x on, returns the passing ones as a bit mask
+    // and stores their encoded depth; the caller keeps all 4 inside the row
+    template <typename Format>
+    inline uint32_t depth_test4(
+        const detail::DepthPlane& plane, float row_z, int x, const typename Format::value_type* depth, uint32_t* z_out
+    )
+    {
+#ifdef HAS_SSE2
+        const __m128 xs = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+        const __m128i z = Format::encode4(_mm_add_ps(_mm_set1_ps(row_z), _mm_mul_ps(_mm_set1_ps(plane.b), xs)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(z_out), z);
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(z, Format::load4(depth + x)))));
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            z_out[i] = Format::encode(plane_z(plane, row_z, x + i));
+            if (z_out[i] < depth[x + i])
+                mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+}
+
+void SoftwareDevice::draw_fill(
+    const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2,
+    const detail::VaryingLayout& varyings, const PowTable* spec_table, bool clip_spans
+)
+{
+    // NOTE: shamelessly stolen from http://forum.devmaster.net/t/advanced-rasterization/6145
+    // TODO: read this http://www.cs.unc.edu/~olano/papers/2dh-tri/
+    const vec<fp4, 3> x = { p0.position.x(), p1.position.x(), p2.position.x() };
+    const vec<fp4, 3> y = { p0.position.y(), p1.position.y(), p2.position.y() };
+
+    // min bounding box
+    const int min_x = ::max(static_cast<int>(::min(x[0], x[1], x[2])), 0);
+    const int max_x = ::min(static_cast<int>(::max(x[0], x[1], x[2])), m_draw_target->get_width());
+    const int min_y = ::max(static_cast<int>(::min(y[0], y[1], y[2])), 0);
+    const int max_y = ::min(static_cast<int>(::max(y[0], y[1], y[2])), m_draw_target->get_height());
+
+    if (min_x >= max_x || min_y >= max_y)
+        return;
+
+    const detail::DepthPlane plane = make_depth_plane(p0.position, p1.position, p2.position);
+
+    // NOTE: a tile still waiting for its depth clear that the triangle covers entirely ends up holding
+    // exactly the triangle depth, so it keeps only the plane and the pixels skip the depth test and write
+    const int tile_size = detail::FRAMEBUFFER_TILE_SIZE;
+    const int tile_x0 = min_x / tile_size, tile_y0 = min_y / tile_size;
+    const int tile_cols = (max_x - 1) / tile_size - tile_x0 + 1;
+    const int tile_rows = (max_y - 1) / tile_size - tile_y0 + 1;
+    bool plane_tiles = false;
+    if (!clip_spans && max_x - min_x >= tile_size && max_y - min_y >= tile_size && has_tiles())
+    {
+        m_plane_tiles.assign(static_cast<size_t>(tile_cols * tile_rows), 0);
+        for (int ty = 0; ty < tile_rows; ty++)
+        {
+            for (int tx = 0; tx < tile_cols; tx++)
+            {
+                const int col = tile_x0 + tx, row = tile_y0 + ty;
+                detail::FramebufferTile& tile = m_tiles[row * m_tile_cols + col];
+                if (tile.depth != detail::TileDepth::Clear)
+                    continue;
+
+                // the whole tile has to be inside the pixels the rows below walk
+                const int px0 = col * tile_size, px1 = ::min(px0 + tile_size, m_tile_width) - 1;
+                const int py0 = row * tile_size, py1 = ::min(py0 + tile_size, m_tile_height) - 1;
+                if (px0 < min_x || px1 >= max_x || py0 < min_y || py1 >= max_y)
+                    continue;
+
+                // covered corners mean a covered tile, the triangle is convex
+                vec3 edges;
+                if (!halfedge_test(x, y, px0, py0, edges) || !halfedge_test(x, y, px1, py0, edges) ||
+                    !halfedge_test(x, y, px0, py1, edges) || !halfedge_test(x, y, px1, py1, edges))
+                    continue;
+
+                // raw for the resolve below, which then only clears its color
+                tile.depth = detail::TileDepth::Raw;
+                m_plane_tiles[ty * tile_cols + tx] = 1;
+                plane_tiles = true;
+            }
+        }
+    }
+
+    resolve_tiles(min_x, min_y, max_x, max_y);
+
+    if (plane_tiles)
+    {
+        for (int ty = 0; ty < tile_rows; ty++)
+        {
+            for (int tx = 0; tx < tile_cols; tx++)
+            {
+                if (!m_plane_tiles[ty * tile_cols + tx])
+                    continue;
+
+                detail::FramebufferTile& tile = m_tiles[(tile_y0 + ty) * m_tile_cols + tile_x0 + tx];
+                tile.depth = detail::TileDepth::Plane;
+                tile.plane = plane;
+            }
+        }
+    }
+
+    // NOTE: distant dense meshes are mostly made of tiny triangles, these get their pixels tested
+    // directly and skip the interpolator setup, zero coverage ones are dropped right here
+    const bool small = max_x - min_x <= SMALL_TRI_SIZE && max_y - min_y <= SMALL_TRI_SIZE;
+    uint32_t small_mask = 0;
+    vec3 small_weights;
+    if (small)
+    {
+        for (int py = min_y; py < max_y; py++)
+        {
+            for (int px = min_x; px < max_x; px++)
+            {
+                vec3 edges;
+                if (!halfedge_test(x, y, px, py, edges))
+                    continue;
+                if (clip_spans && span_hides(m_covered_spans[py], px, py, plane_z(plane, plane_row_z(plane, py), px)))
+                    continue;
+
+                // attributes come from the first covered pixel
+                if (!small_mask)
+                    small_weights = edges;
+                small_mask |= 1u << ((py - min_y) * SMALL_TRI_SIZE + (px - min_x));
+            }
+        }
+
+        if (!small_mask)
+            return;
+    }
+
+    // NOTE: gouraud shaded triangles dont need position/normal per pixel, so the lighting
+    // terms get interpolated in their place
+    const bool vertex_lit = varyings.light_diffuse >= 0;
+
+    // 1/w and the varyings the draw has, nothing else gets interpolated
+    const size_t lerp_count = LERP_VARYINGS + varyings.count;
+    lerp_values values[3];
+    const DevicePoint* points[3] = { &p0, &p1, &p2 };
+    for (size_t k = 0; k < 3; k++)
+    {
+        values[k][LERP_W] = points[k]->position.w();
+        std::copy_n(points[k]->varyings.begin(), varyings.count, values[k].begin() + LERP_VARYINGS);
+    }
+
+    lerp_span span;
+
+    // buffers
+    auto& color_buf = m_draw_target->get_color_buffer();
+    const size_t color_pitch = color_buf.get_stride() * ColorBuffer::get_elem_size(color_buf.get_format());
+    uint8_t* color_ptr = color_buf.lock() + min_y * color_pitch;
+    const ColorWriter writer = get_color_writer(color_buf.get_format());
+
+    auto& depth_buf = m_draw_target->get_depth_buffer();
+    const size_t depth_stride = depth_buf.get_stride();
+    uint8_t* depth_data = depth_buf.lock();
+    const int width = m_draw_target->get_width();
+
+    // unlit fragments stay in packed rgba8 from the sampler to the color buffer, lit ones stay
+    // floats until the color format packs them, unclamped for the hdr formats
+    const bool lighting = m_params.get_material_lighting();
+    const uint32_t flat_rgba = pack_rgba8(m_params.get_material_diffuse());
+    const TextureAddress tex_address = m_params.get_material_texture_address();
+
+    std::array<const SoftwareTexture*, detail::SOFTWARE_TEXTURE_COUNT> textures;
+    size_t texture_count = 0;
+    for (auto unit : m_texture_units)
+    {
+        if (unit)
+            textures[texture_count++] = static_cast<const SoftwareTexture*>(unit);
+    }
+
+    const auto shade_lit = [&](int x, int y)
+    {
+        const float* v = span.varyings();
+        const Color mat_diffuse = [&]
+        {
+            if (varyings.color >= 0)
+                return load_color(v + varyings.color);
+
+            if (varyings.texcoord >= 0 && texture_count > 0)
+            {
+                const vec2 uv = load_vec2(v + varyings.texcoord);
+                Color tex_color;
+
+                // average all the texture units
+                for (size_t i = 0; i < texture_count; i++)
+                    tex_color += textures[i]->sample(uv.x(), uv.y(), tex_address);
+                return Color{ tex_color * (1.0f / texture_count) };
+            }
+
+            return m_params.get_material_diffuse();
+        }();
+
+        // gouraud shaded, lighting came interpolated from the vertices
+        if (vertex_lit)
+        {
+            const vec3 light_diffuse = load_vec3(v + varyings.light_diffuse);
+            const vec3 light_additive = load_vec3(v + varyings.light_additive);
+            return Color{ mat_diffuse % Color{ vec4{ light_diffuse, 1.0f } } + Color{ vec4{ light_additive, 0.0f } } };
+        }
+
+        // lighting calculations in camera-space
+        const vec3 view_pos = load_vec3(v + varyings.view_position);
+        const vec3 normal = varyings.view_normal >= 0 ? load_vec3(v + varyings.view_normal) : vec3{};
+        const vec3 view_norm = spec_table ? normal.normalize_fast() : normal.normalize();
+        const float mat_shininess = m_params.get_material_shininess();
+
+        // NOTE: lights add up, averaging them would make cluster borders visible
+        LightSum sum;
+        for (auto index : m_light_clusters.get_lights(x, y, -view_pos.z()))
+        {
+            const vec3& light_pos = m_light_clusters.get_view_position(index);
+            add_light(sum, m_light_clusters.get_light(index), light_pos, view_pos, view_norm, mat_shininess, spec_table);
+        }
+
+        return Color{
+            m_params.get_material_ambient() % sum.ambient +
+            mat_diffuse % sum.diffuse +
+            m_params.get_material_specular() % sum.specular +
+            m_params.get_material_emissive()
+        };
+    };
+
+    // unlit vertex colors step as 8.8 unorm, the uv as 8.8 texels of each texture
+    static_assert(detail::SOFTWARE_TEXTURE_COUNT * 2 <= lerp_span::FIXED_COUNT, "texture uvs dont fit the fixed point values");
+    if (!lighting)
+    {
+        if (varyings.color >= 0)
+        {
+            for (size_t c = 0; c < 4; c++)
+                span.add_fixed(LERP_VARYINGS + varyings.color + c, 255.0f);
+        }
+        else if (varyings.texcoord >= 0)
+        {
+            for (size_t i = 0; i < texture_count; i++)
+            {
+                span.add_fixed(LERP_VARYINGS + varyings.texcoord, static_cast<float>(textures[i]->get_width()));
+                span.add_fixed(LERP_VARYINGS + varyings.texcoord + 1, static_cast<float>(textures[i]->get_height()));
+            }
+        }
+    }
+
+    // TODO: alpha transparency
+    const auto shade_unlit = [&]() -> uint32_t
+    {
+        if (varyings.color >= 0)
+        {
+            uint32_t ret = 0;
+            for (size_t c = 0; c < 4; c++)
+                ret |= static_cast<uint32_t>(::clamp((span.get_fixed(c) + 128) >> 8, 0, 255)) << (8 * c);
+            return ret;
+        }
+
+        if (varyings.texcoord >= 0 && texture_count > 0)
+        {
+            if (texture_count == 1)
+                return textures[0]->sample_fixed(span.get_fixed(0), span.get_fixed(1), tex_address);
+
+            // average all the texture units
+            uint32_t sum[4] = { 0 };
+            for (size_t i = 0; i < texture_count; i++)
+            {
+                const uint32_t texel = textures[i]->sample_fixed(span.get_fixed(2 * i), span.get_fixed(2 * i + 1), tex_address);
+                for (size_t c = 0; c < 4; c++)
+                    sum[c] += (texel >> (8 * c)) & 0xff;
+            }
+            uint32_t ret = 0;
+            for (size_t c = 0; c < 4; c++)
+                ret |= (sum[c] / texture_count) << (8 * c);
+            return ret;
+        }
+
+        return flat_rgba;
+    };
+
+    // NOTE: fragments gather per 4 pixel group and get packed together once the group is done
+    alignas(16) float group_colors[4][4];
+    alignas(16) uint32_t group_rgba[4];
+    uint32_t group_written = 0;
+
+    // coarse shading, the first covered pixel of a block shades it and the rest of the block copies that;
+    // blocks sit on the screen grid so neighbouring triangles line up, block size in log2 pixels
+    const ShadingRate shading_rate = m_params.get_material_shading_rate();
+    const int rate_x = shading_rate == ShadingRate::Rate2x1 || shading_rate == ShadingRate::Rate2x2 ? 1 : 0;
+    const int rate_y = shading_rate == ShadingRate::Rate1x2 || shading_rate == ShadingRate::Rate2x2 ? 1 : 0;
+    const bool coarse = !small && (rate_x || rate_y);
+    if (coarse)
+        m_coarse_samples.assign(static_cast<size_t>(((max_x - 1) >> rate_x) - (min_x >> rate_x) + 1), detail::CoarseSample{});
+
+    const auto shade = [&](int x, int y)
+    {
+        const int i = x & 3;
+        group_written |= 1u << i;
+
+        detail::CoarseSample* sample = nullptr;
+        if (coarse)
+        {
+            sample = &m_coarse_samples[(x >> rate_x) - (min_x >> rate_x)];
+            if (sample->block_y == y >> rate_y)
+            {
+                if (lighting)
+                    std::copy_n(sample->color, 4, group_colors[i]);
+                else
+                    group_rgba[i] = sample->rgba;
+                return;
+            }
+        }
+
+        if (lighting)
+        {
+            const Color color = shade_lit(x, y);
+            for (int c = 0; c < 4; c++)
+                group_colors[i][c] = color[c];
+        }
+        else
+            group_rgba[i] = shade_unlit();
+
+        if (sample)
+        {
+            sample->block_y = y >> rate_y;
+            if (lighting)
+                std::copy_n(group_colors[i], 4, sample->color);
+            else
+                sample->rgba = group_rgba[i];
+        }
+    };
+
+    const auto store = [&](uint8_t* row, int group_x)
+    {
+        if (!group_written)
+            return;
+
+        if (lighting)
+            writer.store_colors(row, group_x, group_colors, group_written);
+        else
+            writer.store_rgba8(row, group_x, group_rgba, group_written);
+        group_written = 0;
+    };
+
+    detail::dispatch_depth_format(depth_buf.get_format(), [&](auto format)
+    {
+        using Format = decltype(format);
+        using Depth = typename Format::value_type;
+        Depth* depth_ptr = reinterpret_cast<Depth*>(depth_data) + min_y * depth_stride;
+        uint8_t* row_color_ptr = color_ptr;
+
+        if (small)
+        {
+            span.sample(small_weights, values, lerp_count);
+
+            bool shaded = false;
+
+            for (int py = min_y; py < max_y; py++)
+            {
+                const float row_z = plane_row_z(plane, py);
+                for (int px = min_x; px < max_x; px++)
+                {
+                    if (!(small_mask & (1u << ((py - min_y) * SMALL_TRI_SIZE + (px - min_x)))))
+                        continue;
+
+                    const Depth z = Format::encode(plane_z(plane, row_z, px));
+                    Depth& depth = depth_ptr[(py - min_y) * depth_stride + px];
+                    if (!clip_spans && !(z < depth))
+                        continue;
+
+                    // single sample for the whole triangle, shaded at most once into every group slot
+                    if (!shaded)
+                    {
+                        shade(px, py);
+                        for (int i = 1; i < 4; i++)
+                        {
+                            std::copy_n(group_colors[px & 3], 4, group_colors[(px + i) & 3]);
+                            group_rgba[(px + i) & 3] = group_rgba[px & 3];
+                        }
+                        shaded = true;
+                    }
 
-        // frustrum culling - near, far view planes
-        if (v0c.z() < 0.0f && v1c.z() < 0.0f && v2c.z() < 0.0f)
-            continue;
-        if (v0c.z() > 1.0f && v1c.z() > 1.0f && v2c.z() > 1.0f)
-            continue;
+                    group_written = 1u << (px & 3);
+                    store(row_color_ptr + (py - min_y) * color_pitch, px & ~3);
+                    depth = z;
 
-        // transform to device space
-        const vec3 v0d = clip_matrix * v0c;
-        const vec3 v1d = clip_matrix * v1c;
-        const vec3 v2d = clip_matrix * v2c;
+                    if (clip_spans)
+                        insert_span(m_covered_spans[py], px, px + 1, plane);
+                }
+            }
+            return;
+        }
 
-        DevicePoint dp[3];
-        dp[0].position = vec4{ v0d.x(), v0d.y(), v0c.z(), wi0 };
-        dp[1].position = vec4{ v1d.x(), v1d.y(), v1c.z(), wi1 };
-        dp[2].position = vec4{ v2d.x(), v2d.y(), v2c.z(), wi2 };
+        // half-edge interpolation
+        lerp_halfedge he{ x, y, min_x, min_y };
 
-        dp[0].view_position = v0v_3 * wi0;
-        dp[1].view_position = v1v_3 * wi1;
-        dp[2].view_position = v2v_3 * wi2;
+        // attribute interpolation
+        lerp_block attrs{ he, values, lerp_count };
 
-        if (normal_offset >= 0)
+        // span subdivision length from the triangle depth range
+        const int span_length = [&]
+        {
+            if (m_perspective_mode == PerspectiveMode::Exact)
+                return 1;
+
+            const float wi_min = ::min(p0.position.w(), p1.position.w(), p2.position.w());
+            const float wi_max = ::max(p0.position.w(), p1.position.w(), p2.position.w());
+            if (wi_min <= 0)
+                return 1;
+
+            const float ratio = wi_max / wi_min;
+
+            if (ratio <= SPAN_LONG_MAX_RATIO)
+                return SPAN_LONG_LENGTH;
+            if (ratio <= SPAN_SHORT_MAX_RATIO)
+                return SPAN_SHORT_LENGTH;
+            return 1;
+        }();
+
+        // NOTE: depth is tested 4 pixels at a time on groups aligned to the row start, groups that would
+        // run past the target width go per pixel; pixels of plane tiles pass without touching depth
+        alignas(16) uint32_t group_z[4];
+        const auto test_group = [&](const uint8_t* plane_row, float row_z, int gx) -> uint32_t
         {
-            const float* p_n0 = reinterpret_cast<const float*>(vb.data() + normal_offset + ib_ptr[0] * vertex_size);
-            const float* p_n1 = reinterpret_cast<const float*>(vb.data() + normal_offset + ib_ptr[1] * vertex_size);
-            const float* p_n2 = reinterpret_cast<const float*>(vb.data() + normal_offset + ib_ptr[2] * vertex_size);
+            if (plane_row && plane_row[gx / tile_size - tile_x0])
+                return 0xf;
+            if (clip_spans)
+            {
+                for (int i = 0; i < 4; i++)
+                    group_z[i] = Format::encode(plane_z(plane, row_z, gx + i));
+                return 0xf;
+            }
+            if (gx + 4 <= width)
+                return depth_test4<Format>(plane, row_z, gx, depth_ptr, group_z);
 
-            dp[0].view_normal = (normal_matrix * vec3{ p_n0[0], p_n0[1], p_n0[2] }) * wi0;
-            dp[1].view_normal = (normal_matrix * vec3{ p_n1[0], p_n1[1], p_n1[2] }) * wi1;
-            dp[2].view_normal = (normal_matrix * vec3{ p_n2[0], p_n2[1], p_n2[2] }) * wi2;
-        }
+            uint32_t mask = 0;
+            for (int i = 0; gx + i < width; i++)
+            {
+                group_z[i] = Format::encode(plane_z(plane, row_z, gx + i));
+                if (group_z[i] < depth_ptr[gx + i])
+                    mask |= 1u << i;
+            }
+            return mask;
+        };
 
-        if (color_offset >= 0)
+        // shades [x0, x1) of the current row, the interpolators need to be at x0
+        int covered_x0, covered_x1;
+        const auto fill_row = [&](int y, int x0, int x1)
         {
-            const float* p_c0 = reinterpret_cast<const float*>(vb.data() + color_offset + ib_ptr[0] * vertex_size);
-            const float* p_c1 = reinterpret_cast<const float*>(vb.data() + color_offset + ib_ptr[1] * vertex_size);
-            const float* p_c2 = reinterpret_cast<const float*>(vb.data() + color_offset + ib_ptr[2] * vertex_size);
+            const float row_z = plane_row_z(plane, y);
+            const uint8_t* plane_row = plane_tiles ? &m_plane_tiles[(y / tile_size - tile_y0) * tile_cols] : nullptr;
 
-            // TODO: make a ptr-based vec3
-            dp[0].color = Color{ p_c0[0], p_c0[1], p_c0[2], p_c0[3] } * wi0;
-            dp[1].color = Color{ p_c1[0], p_c1[1], p_c1[2], p_c1[3] } * wi1;
-            dp[2].color = Color{ p_c2[0], p_c2[1], p_c2[2], p_c2[3] } * wi2;
-        }
+            int span_left = 0;
+            int group_x = -1;
+            uint32_t group_pass = 0;
+            for (int x = x0; x < x1; x++)
+            {
+                if (span_left == 0)
+                    span_left = span.begin(attrs, ::min(span_length, x1 - x));
 
-        if (texcoord_offset >= 0)
-        {
-            const float* p_uv0 = reinterpret_cast<const float*>(vb.data() + texcoord_offset + ib_ptr[0] * vertex_size);
-            const float* p_uv1 = reinterpret_cast<const float*>(vb.data() + texcoord_offset + ib_ptr[1] * vertex_size);
-            const float* p_uv2 = reinterpret_cast<const float*>(vb.data() + texcoord_offset + ib_ptr[2] * vertex_size);
+                if ((x & ~3) != group_x)
+                {
+                    store(row_color_ptr, group_x);
+                    group_x = x & ~3;
+                    group_pass = test_group(plane_row, row_z, group_x);
+                }
 
-            dp[0].texcoord = vec2{ p_uv0[0], p_uv0[1] } * wi0;
-            dp[1].texcoord = vec2{ p_uv1[0], p_uv1[1] } * wi1;
-            dp[2].texcoord = vec2{ p_uv2[0], p_uv2[1] } * wi2;
-        }
+                if (he.value()[0] > 0 && he.value()[1] > 0 && he.value()[2] > 0 && (group_pass & (1u << (x & 3))))
+                {
+                    shade(x, y);
+
+                    if (!plane_row || !plane_row[x / tile_size - tile_x0])
+                        depth_ptr[x] = static_cast<Depth>(group_z[x & 3]);
+
+                    covered_x0 = ::min(covered_x0, x);
+                    covered_x1 = x + 1;
+                }
+
+                he.incr_x();
+                span.incr_x();
+                span_left--;
+            }
+            store(row_color_ptr, group_x);
+        };
 
-        if (m_debug_normals)
+        for (int y = min_y; y < max_y; y++)
         {
-            for (int i = 0; i < 3; i++)
+            covered_x0 = max_x;
+            covered_x1 = min_x;
+
+            if (!clip_spans)
+                fill_row(y, min_x, max_x);
+            else
             {
-                // compute screen-space (vertex + normal)
-                vec3 v_dn = dp[i].view_position.value() * (1.0f / wi0) + dp[i].view_normal.value().normalize() * 0.5f;
-                vec4 v_dnc = proj_matrix * vec4{ v_dn, 1.0f };
-                v_dnc *= 1.0f / v_dnc.w();
-                vec3 v_dnd = clip_matrix * v_dnc;
+                // NOTE: only the pixels where the triangle is nearer than the covered spans get walked,
+                // the triangle covers a single interval of the row so each visible part covers one too
+                auto& covered = m_covered_spans[y];
+                m_visible_spans.clear();
+                find_visible_spans(covered, min_x, max_x, y, plane, m_visible_spans);
+
+                int x = min_x;
+                for (const auto& visible : m_visible_spans)
+                {
+                    he.incr_x(visible.x0 - x);
+                    attrs.incr_x(visible.x0 - x);
 
-                DevicePoint n_dp[2];
-                n_dp[0].position = dp[i].position;
-                n_dp[1].position = vec4{ v_dnd.x(), v_dnd.y(), 0, 0 };
-                draw_lines({n_dp[0], n_dp[1]});
-            }
-        }
+                    covered_x0 = max_x;
+                    covered_x1 = min_x;
+                    fill_row(y, visible.x0, visible.x1);
+                    x = visible.x1;
 
-        draw_tri(dp[0], dp[1], dp[2]);
-    }
-}
+                    if (covered_x0 < covered_x1)
+                        insert_span(covered, covered_x0, covered_x1, plane);
+                }
+            }
 
-void SoftwareDevice::draw_tri(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2)
-{
-    switch (m_poly_mode)
-    {
-        case PolygonMode::Point:
-            draw_points({ p0, p1, p2 });
-            break;
+            he.incr_y();
+            attrs.incr_y();
 
-        case PolygonMode::Line:
-            draw_lines({ p0, p1, p2, p0 });
-            break;
+            row_color_ptr += color_pitch;
+            depth_ptr += depth_stride;
+        }
+    });
 
-        case PolygonMode::Fill:
-            draw_fill(p0, p1, p2);
-            break;
-    }
+    depth_buf.unlock();
+    color_buf.unlock();
 }
 
-namespace
+void SoftwareDevice::draw_line_batch()
 {
-    class lerp_halfedge
-    {
-        using fp4v = vec<fp4, 3>;
-        using fp8v = vec<fp8, 3>;
+    if (m_line_batch.empty())
+        return;
 
-    public:
-        lerp_halfedge(const fp4v& x, const fp4v& y, fp4 x0, fp4 y0) :
-            // deltas in fp4
-            dx4{ x[0] - x[1], x[1] - x[2], x[2] - x[0] },
-            dy4{ y[0] - y[1], y[1] - y[2], y[2] - y[0] },
+    int bounds_x0, bounds_y0, bounds_x1, bounds_y1;
+    batch_bounds(m_line_batch, bounds_x0, bounds_y0, bounds_x1, bounds_y1);
+    resolve_tiles(bounds_x0, bounds_y0, bounds_x1, bounds_y1);
 
-            // constant part of half-edge functions + fill correction (left sides are filled on +1, right sides are not)
-            const8 {
-                dy4[0].denorm_mul(x[0]) - dx4[0].denorm_mul(y[0]) + (dy4[0] < 0 || (dy4[0] == 0 && dx4[0] > 0)),
-                dy4[1].denorm_mul(x[1]) - dx4[1].denorm_mul(y[1]) + (dy4[1] < 0 || (dy4[1] == 0 && dx4[1] > 0)),
-                dy4[2].denorm_mul(x[2]) - dx4[2].denorm_mul(y[2]) + (dy4[2] < 0 || (dy4[2] == 0 && dx4[2] > 0))
-            },
+    auto& color_buf = m_draw_target->get_color_buffer();
+    const size_t color_pitch = color_buf.get_stride() * ColorBuffer::get_elem_size(color_buf.get_format());
+    uint8_t* color_ptr = color_buf.lock();
+    const ColorWriter writer = get_color_writer(color_buf.get_format());
 
-            // running half-edge values, all in fixed-point 8 frac digits
-            value_y {
-                const8[0] + dx4[0].denorm_mul(y0) - dy4[0].denorm_mul(x0),
-                const8[1] + dx4[1].denorm_mul(y0) - dy4[1].denorm_mul(x0),
-                const8[2] + dx4[2].denorm_mul(y0) - dy4[2].denorm_mul(x0)
-            },
-            value_x{ 0, 0, 0 },
-            dx{ dx4[0], dx4[1], dx4[2] },
-            dy{ dy4[0], dy4[1], dy4[2] },
+    auto& depth_buf = m_draw_target->get_depth_buffer();
+    const size_t depth_stride = depth_buf.get_stride();
+    uint8_t* depth_data = depth_buf.lock();
 
-            // deltas in float
-            fdx{ static_cast<float>(dx4[0]), static_cast<float>(dx4[1]), static_cast<float>(dx4[2]) },
-            fdy{ static_cast<float>(dy4[0]), static_cast<float>(dy4[1]), static_cast<float>(dy4[2]) },
+    // whole group of the wire color, single pixels get written out of it
+    const uint32_t wire_rgba = pack_rgba8(WIRE_COLOR);
+    const uint32_t wire_group[4] = { wire_rgba, wire_rgba, wire_rgba, wire_rgba };
+    const float max_x = static_cast<float>(m_draw_target->get_width() - 1);
+    const float max_y = static_cast<float>(m_draw_target->get_height() - 1);
 
-            // interpolation normalization
-            lerp_norm{ 1.0f / (fdx[0] * fdy[2] - fdx[2] * fdy[0]) },
+    detail::dispatch_depth_format(depth_buf.get_format(), [&](auto format)
+    {
+        using Format = decltype(format);
+        using Depth = typename Format::value_type;
+        Depth* depth_ptr = reinterpret_cast<Depth*>(depth_data);
 
-            // weights for 0,1,2 lerp dot products
-            weight {
-                static_cast<float>(value_y[1]) * lerp_norm,
-                static_cast<float>(value_y[2]) * lerp_norm,
-                static_cast<float>(value_y[0]) * lerp_norm
-            },
-            weight_dx { fdx[1] * lerp_norm, fdx[2] * lerp_norm, fdx[0] * lerp_norm },
-            weight_dy { fdy[1] * lerp_norm, fdy[2] * lerp_norm, fdy[0] * lerp_norm }
+        for (size_t i = 0; i + 1 < m_line_batch.size(); i += 2)
         {
-            // first iteration values
-            value_x = value_y;
-        }
-        ~lerp_halfedge() = default;
+            vec4 a = m_line_batch[i], b = m_line_batch[i + 1];
+            if (!clip_line(a, b, max_x, max_y))
+                continue;
 
-    public:
-        const fp8v& value() const
-        {
-            return value_x;
-        }
+            // DDA, one step per pixel along the major axis; z is affine in screen-space
+            const vec4 d = b - a;
+            const int steps = static_cast<int>(std::ceil(std::max(std::abs(d.x()), std::abs(d.y()))));
+            const vec4 step = steps > 0 ? d * (1.0f / steps) : vec4{};
 
-        const vec3& w() const
-        {
-            return weight;
-        }
+            vec4 p = a;
+            for (int s = 0; s <= steps; s++, p += step)
+            {
+                const int x = static_cast<int>(p.x() + 0.5f);
+                const int y = static_cast<int>(p.y() + 0.5f);
 
-        const vec3& w_dx() const
-        {
-            return weight_dx;
+                const Depth z = Format::encode(p.z());
+                Depth& depth = depth_ptr[y * depth_stride + x];
+                if (z <= depth)
+                {
+                    writer.store_rgba8(color_ptr + y * color_pitch, x, wire_group, 1);
+                    depth = z;
+                }
+            }
         }
+    });
+    m_line_batch.clear();
 
-        const vec3& w_dy() const
-        {
-            return weight_dy;
-        }
+    depth_buf.unlock();
+    color_buf.unlock();
+}
 
-        void incr_y()
-        {
-            value_y += dx;
-            value_x = value_y;
-        }
+void SoftwareDevice::draw_point_batch()
+{
+    if (m_point_batch.empty())
+        return;
 
-        void incr_x()
-        {
-            value_x -= dy;
-        }
+    int bounds_x0, bounds_y0, bounds_x1, bounds_y1;
+    batch_bounds(m_point_batch, bounds_x0, bounds_y0, bounds_x1, bounds_y1);
+    resolve_tiles(bounds_x0, bounds_y0, bounds_x1, bounds_y1);
 
-    private:
-        // NOTE: these need to be places here in order for init to work correctly
-        const fp4v dx4, dy4;
-        const fp8v const8;
-        const vec3 fdx, fdy;
-        const float lerp_norm;
+    auto& color_buf = m_draw_target->get_color_buffer();
+    const size_t color_pitch = color_buf.get_stride() * ColorBuffer::get_elem_size(color_buf.get_format());
+    uint8_t* color_ptr = color_buf.lock();
+    const ColorWriter writer = get_color_writer(color_buf.get_format());
 
-        fp8v value_x, value_y;
-        const fp8v dx, dy;
+    auto& depth_buf = m_draw_target->get_depth_buffer();
+    const size_t depth_stride = depth_buf.get_stride();
+    uint8_t* depth_data = depth_buf.lock();
 
-        // weights
-        const vec3 weight;
-        const vec3 weight_dx;
-        const vec3 weight_dy;
-    };
+    const uint32_t wire_rgba = pack_rgba8(WIRE_COLOR);
+    const uint32_t wire_group[4] = { wire_rgba, wire_rgba, wire_rgba, wire_rgba };
+    const int width = m_draw_target->get_width();
+    const int height = m_draw_target->get_height();
 
-    template <typename T>
-    class lerp_attr
+    detail::dispatch_depth_format(depth_buf.get_format(), [&](auto format)
     {
-    public:
-        lerp_attr(const lerp_halfedge& he, const vec<T, 3>& attr) :
-            value_y{ attr[0] * he.w()[0] + attr[1] * he.w()[1] + attr[2] * he.w()[2] },
-            dx{ attr[0] * he.w_dx()[0] + attr[1] * he.w_dx()[1] + attr[2] * he.w_dx()[2] },
-            dy{ attr[0] * he.w_dy()[0] + attr[1] * he.w_dy()[1] + attr[2] * he.w_dy()[2] }
-        {
-            // first iteration values
-            m_value_x = value_y;
-        }
-        ~lerp_attr() = default;
+        using Format = decltype(format);
+        using Depth = typename Format::value_type;
+        Depth* depth_ptr = reinterpret_cast<Depth*>(depth_data);
 
-        const T& value() const
+        for (const vec4& p : m_point_batch)
         {
-            return m_value_x;
+            const int x = static_cast<int>(std::floor(p.x() + 0.5f));
+            const int y = static_cast<int>(std::floor(p.y() + 0.5f));
+            if (x < 0 || y < 0 || x >= width || y >= height)
+                continue;
+
+            const Depth z = Format::encode(p.z());
+            Depth& depth = depth_ptr[y * depth_stride + x];
+            if (z <= depth)
+            {
+                writer.store_rgba8(color_ptr + y * color_pitch, x, wire_group, 1);
+                depth = z;
+            }
         }
+    });
+    m_point_batch.clear();
 
-        void incr_y()
-        {
-            value_y += dx;
-            m_value_x = value_y;
-        }
+    depth_buf.unlock();
+    color_buf.unlock();
+}
 
-        void incr_x()
-        {
-            m_value_x -= dy;
-        }
+///////////////////////////////////////////////////////////////////////////////
+// Clear methods
+///////////////////////////////////////////////////////////////////////////////
+void SoftwareDevice::clear_tiles()
+{
+    const int size = detail::FRAMEBUFFER_TILE_SIZE;
 
-    private:
-        T m_value_x, value_y;
-        const T dx;
-        const T dy;
-    };
+    m_tile_target = m_draw_target;
+    m_tile_width = m_draw_target->get_width();
+    m_tile_height = m_draw_target->get_height();
+    m_tile_cols = (m_tile_width + size - 1) / size;
+
+    const int rows = (m_tile_height + size - 1) / size;
+    const detail::FramebufferTile cleared{ true, detail::TileDepth::Clear, detail::DepthPlane{} };
+    m_tiles.assign(static_cast<size_t>(m_tile_cols * rows), cleared);
+}
+
+bool SoftwareDevice::has_tiles()
+{
+    if (m_tiles.empty() || m_tile_target != m_draw_target)
+        return false;
 
-    template <typename... Attrs>
-    class lerp_pack
+    // NOTE: a resize reallocates the buffers, whatever was pending is gone with them
+    if (m_tile_width != m_draw_target->get_width() || m_tile_height != m_draw_target->get_height())
     {
-    public:
-        lerp_pack(lerp_attr<Attrs>&&... args) :
-            m_data{ std::forward<lerp_attr<Attrs>>(args)... }
-        {}
-        ~lerp_pack() = default;
+        m_tiles.clear();
+        return false;
+    }
 
-        void incr_y()
-        {
-            incr_y(std::make_index_sequence<sizeof...(Attrs)>());
-        }
+    return true;
+}
 
-        void incr_x()
-        {
-            incr_x(std::make_index_sequence<sizeof...(Attrs)>());
-        }
+void SoftwareDevice::resolve_tiles(int x0, int y0, int x1, int y1)
+{
+    if (!has_tiles())
+        return;
+
+    x0 = ::max(x0, 0);
+    y0 = ::max(y0, 0);
+    x1 = ::min(x1, m_tile_width);
+    y1 = ::min(y1, m_tile_height);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    // buffers only get locked once a pending tile shows up
+    auto& color_buf = m_draw_target->get_color_buffer();
+    auto& depth_buf = m_draw_target->get_depth_buffer();
+    const size_t color_elem_size = ColorBuffer::get_elem_size(color_buf.get_format());
+    uint8_t* color_ptr = nullptr;
+    uint8_t* depth_data = nullptr;
+
+    detail::dispatch_depth_format(depth_buf.get_format(), [&](auto format)
+    {
+        using Format = decltype(format);
+        using Depth = typename Format::value_type;
 
-        template <size_t I, typename Attr = typename typelist_at<I, Attrs...>::type>
-        const lerp_attr<Attr>& get() const
+        const int size = detail::FRAMEBUFFER_TILE_SIZE;
+        for (int ty = y0 / size; ty <= (y1 - 1) / size; ty++)
         {
-            return std::get<I>(m_data);
-        }
+            for (int tx = x0 / size; tx <= (x1 - 1) / size; tx++)
+            {
+                detail::FramebufferTile& tile = m_tiles[ty * m_tile_cols + tx];
+                if (!tile.color_clear && tile.depth == detail::TileDepth::Raw)
+                    continue;
 
-    private:
-        template <size_t... I>
-        void incr_y(std::index_sequence<I...>)
-        {
-            using swallow = int[];
-            (void)swallow{ (std::get<I>(m_data).incr_y(), 0)... };
-        }
+                if (!color_ptr)
+                {
+                    color_ptr = color_buf.lock();
+                    depth_data = depth_buf.lock();
+                }
 
-        template <size_t... I>
-        void incr_x(std::index_sequence<I...>)
-        {
-            using swallow = int[];
-            (void)swallow{ (std::get<I>(m_data).incr_x(), 0)... };
+                // regular stores, the draw that asked for the tile reads it right after
+                const int px0 = tx * size, px1 = ::min(px0 + size, m_tile_width);
+                const int py1 = ::min((ty + 1) * size, m_tile_height);
+                for (int y = ty * size; y < py1; y++)
+                {
+                    if (tile.color_clear)
+                        std::memset(color_ptr + (y * color_buf.get_stride() + px0) * color_elem_size, 0, (px1 - px0) * color_elem_size);
+
+                    Depth* row = reinterpret_cast<Depth*>(depth_data) + y * depth_buf.get_stride();
+                    if (tile.depth == detail::TileDepth::Clear)
+                        std::fill(row + px0, row + px1, Format::CLEAR);
+                    else if (tile.depth == detail::TileDepth::Plane)
+                    {
+                        const float row_z = plane_row_z(tile.plane, y);
+                        for (int x = px0; x < px1; x++)
+                            row[x] = Format::encode(plane_z(tile.plane, row_z, x));
+                    }
+                }
+
+                tile.color_clear = false;
+                tile.depth = detail::TileDepth::Raw;
+            }
         }
+    });
 
-        tuple<lerp_attr<Attrs>...> m_data;
-    };
+    if (color_ptr)
+    {
+        depth_buf.unlock();
+        color_buf.unlock();
+    }
 }
 
-void SoftwareDevice::draw_fill(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2)
+void SoftwareDevice::resolve_color()
 {
-    // NOTE: shamelessly stolen from http://forum.devmaster.net/t/advanced-rasterization/6145
-    // TODO: read this http://www.cs.unc.edu/~olano/papers/2dh-tri/
-    const vec<fp4, 3> x = { p0.position.x(), p1.position.x(), p2.position.x() };
-    const vec<fp4, 3> y = { p0.position.y(), p1.position.y(), p2.position.y() };
+    if (!has_tiles())
+        return;
 
-    // TODO: if-constexpr could really benefit this function
-    const vec<vec3, 3> view_positions = {
-        p0.view_position.has_value() ? p0.view_position.value() : vec3{},
-        p1.view_position.has_value() ? p1.view_position.value() : vec3{},
-        p2.view_position.has_value() ? p2.view_position.value() : vec3{}
-    };
+    auto& color_buf = m_draw_target->get_color_buffer();
+    const size_t elem_size = ColorBuffer::get_elem_size(color_buf.get_format());
+    const size_t color_pitch = color_buf.get_stride() * elem_size;
+    uint8_t* color_ptr = color_buf.lock();
 
-    const vec<vec3, 3> normals = {
-        p0.view_normal.has_value() ? p0.view_normal.value() : vec3{},
-        p1.view_normal.has_value() ? p1.view_normal.value() : vec3{},
-        p2.view_normal.has_value() ? p2.view_normal.value() : vec3{}
-    };
+    const int size = detail::FRAMEBUFFER_TILE_SIZE;
+    for (size_t i = 0; i < m_tiles.size(); i++)
+    {
+        detail::FramebufferTile& tile = m_tiles[i];
+        if (!tile.color_clear)
+            continue;
 
-    const vec<Color, 3> colors = {
-        p0.color.has_value() ? p0.color.value() : Color{},
-        p1.color.has_value() ? p1.color.value() : Color{},
-        p2.color.has_value() ? p2.color.value() : Color{}
-    };
+        const int tx = static_cast<int>(i) % m_tile_cols;
+        const int ty = static_cast<int>(i) / m_tile_cols;
+        const int px0 = tx * size, px1 = ::min(px0 + size, m_tile_width);
+        const int py1 = ::min((ty + 1) * size, m_tile_height);
+        for (int y = ty * size; y < py1; y++)
+            clear_stream(color_ptr + y * color_pitch + px0 * elem_size, (px1 - px0) * elem_size);
 
-    const vec<vec2, 3> texcoords = {
-        p0.texcoord.has_value() ? p0.texcoord.value() : vec2{},
-        p1.texcoord.has_value() ? p1.texcoord.value() : vec2{},
-        p2.texcoord.has_value() ? p2.texcoord.value() : vec2{}
-    };
+        // depth stays pending or as a plane, the next clear flags it again anyway
+        tile.color_clear = false;
+    }
 
-    // min bounding box
-    const int min_x = ::max(static_cast<int>(::min(x[0], x[1], x[2])), 0);
-    const int max_x = ::min(static_cast<int>(::max(x[0], x[1], x[2])), m_render_target->get_width());
-    const int min_y = ::max(static_cast<int>(::min(y[0], y[1], y[2])), 0);
-    const int max_y = ::min(static_cast<int>(::max(y[0], y[1], y[2])), m_render_target->get_height());
+#ifdef HAS_SSE2
+    _mm_sfence();
+#endif
 
-    // half-edge interpolation
-    lerp_halfedge he{ x, y, min_x, min_y };
+    color_buf.unlock();
+}
 
-    // attribute interpolation
-    lerp_pack<float, float, vec3, vec3, Color, vec2> attrs
+///////////////////////////////////////////////////////////////////////////////
+// Target methods
+///////////////////////////////////////////////////////////////////////////////
+void SoftwareDevice::update_draw_target()
+{
+    const float scale = m_resolution.get_scale();
+    const bool null_target = m_render_target == m_null_target.get();
+    const ColorBufferFormat target_format =
+        null_target ? m_intermediate_format : m_render_target->get_color_buffer().get_format();
+    const ColorBufferFormat format = m_intermediate_enable ? m_intermediate_format : target_format;
+    if (null_target || (format == target_format && scale >= 1.0f))
     {
-        { he, { p0.position.z(), p1.position.z(), p2.position.z() } },
-        { he, { p0.position.w(), p1.position.w(), p2.position.w() } },
-        { he, view_positions },
-        { he, normals },
-        { he, colors },
-        { he, texcoords }
-    };
+        m_draw_target = m_render_target;
+        m_intermediate = nullptr;
+        return;
+    }
 
-    // buffers
-    auto& color_buf = m_render_target->get_color_buffer();
-    const size_t color_stride = color_buf.get_stride();
-    uint32_t* color_ptr = color_buf.lock() + min_y * color_stride;
-    ColorBufferFormat color_format = color_buf.get_format();
+    const int width = ::max(static_cast<int>(m_render_target->get_width() * scale + 0.5f), 1);
+    const int height = ::max(static_cast<int>(m_render_target->get_height() * scale + 0.5f), 1);
+    if (!m_intermediate || m_intermediate->get_color_buffer().get_format() != format)
+    {
+        m_intermediate = std::make_unique<SoftwareRenderTarget>(
+            width, height, format, m_render_target->get_depth_buffer().get_format()
+        );
+        log_info("Created intermediate target, format = %d", static_cast<int>(format));
+    }
+    else
+        m_intermediate->resize(width, height);
 
-    auto& depth_buf = m_render_target->get_depth_buffer();
-    const size_t depth_stride = depth_buf.get_stride();
-    float* depth_ptr = depth_buf.lock() + min_y * depth_stride;
+    m_draw_target = m_intermediate.get();
+}
 
-    for (int y = min_y; y < max_y; y++)
+void SoftwareDevice::resolve_intermediate()
+{
+    if (m_draw_target == m_render_target)
+        return;
+
+    // untouched tiles still hold the previous frame
+    resolve_color();
+
+    auto& src_buf = m_draw_target->get_color_buffer();
+    auto& dst_buf = m_render_target->get_color_buffer();
+    const size_t src_stride = src_buf.get_stride();
+    const size_t dst_pitch = dst_buf.get_stride() * ColorBuffer::get_elem_size(dst_buf.get_format());
+    const uint8_t* src_data = src_buf.lock();
+    uint8_t* dst_data = dst_buf.lock();
+
+    const ColorWriter writer = get_color_writer(dst_buf.get_format());
+    const int src_width = m_draw_target->get_width();
+    const int src_height = m_draw_target->get_height();
+    const int width = m_render_target->get_width();
+    const int height = m_render_target->get_height();
+
+    // NOTE: goes thru rgba8, so hdr values just clamp to the displayable range
+    if (src_width == width && src_height == height)
     {
-        for (int x = min_x; x < max_x; x++)
+        detail::dispatch_color_format(src_buf.get_format(), [&](auto traits)
         {
-            const float w = 1.0f / attrs.get<1>().value();
-            // TODO: pretty sure this isnt right, should be 1/zi_x
-            const float z = attrs.get<0>().value() * w;
-
-            if (he.value()[0] > 0 && he.value()[1] > 0 && he.value()[2] > 0 && z < depth_ptr[x])
+            using Format = decltype(traits);
+            for (int y = 0; y < height; y++)
             {
-                // TODO: alpha transparency
-                const Color mat_diffuse = [&]
+                const auto* src = reinterpret_cast<const typename Format::value_type*>(src_data) + y * src_stride;
+                uint8_t* dst = dst_data + y * dst_pitch;
+                for (int x = 0; x < width; x += 4)
                 {
-                    if (p0.color.has_value())
-                        return static_cast<Color>(attrs.get<4>().value() * w);
-
-                    if (p0.texcoord.has_value())
-                    {
-                        const vec2 uv = attrs.get<5>().value() * w;
-                        Color tex_color;
-                        float count = 0;
-
-                        // average all the texture units
-                        for (auto unit : m_texture_units)
-                        {
-                            if (!unit)
-                                continue;
-
-                            auto tex = static_cast<const SoftwareTexture*>(unit);
-                            tex_color += tex->sample(uv.x(), uv.y());
-                            count += 1;
-                        }
-                        return Color{ tex_color * (1.0f / count) };
-                    }
+                    const int count = ::min(width - x, 4);
+                    uint32_t rgba[4] = {};
+                    for (int i = 0; i < count; i++)
+                        rgba[i] = Format::unpack_rgba8(src[x + i]);
+                    writer.store_rgba8(dst, x, rgba, (1u << count) - 1);
+                }
+            }
+        });
 
-                    return m_params.get_material_diffuse();
-                }();
+        dst_buf.unlock();
+        src_buf.unlock();
+        return;
+    }
 
-                const Color frag_color = [&]
-                {
-                    if (!m_params.get_material_lighting())
-                        return mat_diffuse;
+    // bilinear upscale, pixel centers map onto each other and the edges clamp;
+    // source coords are 8.8 fixed point like the texture sampler ones
+    auto source_coord = [](int x, int src_size, int dst_size)
+    {
+        const int64_t coord = (static_cast<int64_t>(2 * x + 1) * src_size * 256) / (2 * dst_size) - 128;
+        return static_cast<int32_t>(clamp<int64_t>(coord, 0, (src_size - 1) * 256));
+    };
 
-                    const Color& mat_ambient = m_params.get_material_ambient();
-                    const Color& mat_specular = m_params.get_material_specular();
-                    const Color& mat_emissive = m_params.get_material_emissive();
-                    const float mat_shininess = m_params.get_material_shininess();
+    // horizontal footprint is the same for every row: left texel and weight of the right one
+    m_upscale_coords.resize(width);
+    for (int x = 0; x < width; x++)
+        m_upscale_coords[x] = source_coord(x, src_width, width);
 
-                    // lighting calculations in camera-space
-                    const vec3 view_pos = attrs.get<2>().value() * w;
-                    const vec3 view_norm = (attrs.get<3>().value() * w).normalize();
+    // the 2 source rows in use unpacked to rgba8, a row past the end just repeats the last one
+    m_upscale_rows.resize(2 * (src_width + 1));
+    uint32_t* rows[2] = { m_upscale_rows.data(), m_upscale_rows.data() + src_width + 1 };
+    int rows_y = -1;
 
-                    Color ambient, diffuse, specular;
-                    float light_count = 0;
-                    for (size_t i = 0; i < m_light_units.size(); i++)
-                    {
-                        auto& light = m_light_units[i];
-                        if (!light)
-                            continue;
-
-                        const vec3 light_dir_denorm = m_light_view_positions[i] - view_pos;
-                        const vec3 light_dir = light_dir_denorm.normalize();
-                        const float light_dist = light_dir_denorm.length();
-
-                        auto& atten_coef = light->get_attenuation();
-                        const float light_atten = 1.0f / (
-                            atten_coef[1] +
-                            atten_coef[2] * light_dist,
-                            atten_coef[3] * light_dist * light_dist
-                        );
-
-                        // ambient color
-                        ambient += mat_ambient % light->get_ambient() * light_atten;
-
-                        // diffuse color
-                        const float diff_coef = std::max(0.0f, view_norm * light_dir);
-                        diffuse += mat_diffuse % light->get_diffuse() * diff_coef * light_atten;
-
-                        // specular color
-                        if (diff_coef > 0)
-                        {
-                            const vec3 half_vec = (light_dir - view_pos).normalize();
-                            const float spec_coef = pow(std::max(0.0f, view_norm * half_vec), mat_shininess);
-                            specular += mat_specular % light->get_specular() * spec_coef * light_atten;
-                        }
-                        light_count ++;
-                    }
+    detail::dispatch_color_format(src_buf.get_format(), [&](auto traits)
+    {
+        using Format = decltype(traits);
+        auto unpack_row = [&](uint32_t* row, int y)
+        {
+            const auto* src = reinterpret_cast<const typename Format::value_type*>(src_data) + y * src_stride;
+            for (int x = 0; x < src_width; x++)
+                row[x] = Format::unpack_rgba8(src[x]);
+            row[src_width] = row[src_width - 1];
+        };
 
-                    return Color{ (ambient + diffuse + specular) * (1.0f / light_count) + mat_emissive };
-                }();
+        for (int y = 0; y < height; y++)
+        {
+            const int32_t v = source_coord(y, src_height, height);
+            const int y0 = v >> 8;
+            if (y0 != rows_y)
+            {
+                // NOTE: rows only move down, stepping one source row keeps the old bottom row as the new top
+                if (rows_y >= 0 && y0 == rows_y + 1)
+                    std::swap(rows[0], rows[1]);
+                else
+                    unpack_row(rows[0], y0);
+                unpack_row(rows[1], ::min(y0 + 1, src_height - 1));
+                rows_y = y0;
+            }
+            const uint32_t fy = v & 0xff;
 
-                switch (color_format)
+            uint8_t* dst = dst_data + y * dst_pitch;
+            for (int x = 0; x < width; x += 4)
+            {
+                const int count = ::min(width - x, 4);
+                uint32_t rgba[4] = {};
+                for (int i = 0; i < count; i++)
                 {
-                    case ColorBufferFormat::ARGB8:
-                        color_ptr[x] = (
-                            (static_cast<uint8_t>(clamp(frag_color.r(), 0.0f, 1.0f) * 255.0f) << 16) +
-                            (static_cast<uint8_t>(clamp(frag_color.g(), 0.0f, 1.0f) * 255.0f) <<  8) +
-                            (static_cast<uint8_t>(clamp(frag_color.b(), 0.0f, 1.0f) * 255.0f))
-                        );
-                        break;
-
-                    case ColorBufferFormat::xBGR8:
-                        color_ptr[x] = (
-                            (static_cast<uint8_t>(clamp(frag_color.b(), 0.0f, 1.0f) * 255.0f) << 16) +
-                            (static_cast<uint8_t>(clamp(frag_color.g(), 0.0f, 1.0f) * 255.0f) <<  8) +
-                            (static_cast<uint8_t>(clamp(frag_color.r(), 0.0f, 1.0f) * 255.0f))
-                        );
-                        break;
-
-                    default:
-                        throw std::runtime_error("unusable color buffer format");
+                    const int32_t u = m_upscale_coords[x + i];
+                    const int x0 = u >> 8;
+                    rgba[i] = detail::rgba8_bilerp(
+                        rows[0][x0], rows[0][x0 + 1],
+                        rows[1][x0], rows[1][x0 + 1],
+                        u & 0xff, fy
+                    );
                 }
-
-                depth_ptr[x] = z;
+                writer.store_rgba8(dst, x, rgba, (1u << count) - 1);
             }
-
-            he.incr_x();
-            attrs.incr_x();
         }
+    });
 
-        he.incr_y();
-        attrs.incr_y();
+    dst_buf.unlock();
+    src_buf.unlock();
+}
 
-        color_ptr += color_stride;
-        depth_ptr += depth_stride;
+void SoftwareDevice::store_layer()
+{
+    if (m_raster_mode == RasterMode::SpanBuffer || m_draw_target == m_null_target.get())
+    {
+        m_layer = nullptr;
+        return;
     }
 
-    depth_buf.unlock();
-    color_buf.unlock();
+    // the layer is plain pixels: deferred triangles get drawn, pending clears and depth planes written out
+    draw_deferred();
+    resolve_tiles(0, 0, m_draw_target->get_width(), m_draw_target->get_height());
+
+    const int width = m_draw_target->get_width();
+    const int height = m_draw_target->get_height();
+    const ColorBufferFormat color_format = m_draw_target->get_color_buffer().get_format();
+    const DepthBufferFormat depth_format = m_draw_target->get_depth_buffer().get_format();
+    if (!m_layer ||
+        m_layer->get_color_buffer().get_format() != color_format ||
+        m_layer->get_depth_buffer().get_format() != depth_format)
+    {
+        m_layer = std::make_unique<SoftwareRenderTarget>(width, height, color_format, depth_format);
+        log_info("Created static layer");
+    }
+    else
+        m_layer->resize(width, height);
+
+    copy_target(*m_draw_target, *m_layer);
+}
+
+bool SoftwareDevice::restore_layer()
+{
+    // NOTE: a resolution or format change since the snapshot makes it useless
+    const bool fits =
+        m_layer && m_raster_mode != RasterMode::SpanBuffer && m_draw_target != m_null_target.get() &&
+        m_layer->get_width() == m_draw_target->get_width() &&
+        m_layer->get_height() == m_draw_target->get_height() &&
+        m_layer->get_color_buffer().get_format() == m_draw_target->get_color_buffer().get_format() &&
+        m_layer->get_depth_buffer().get_format() == m_draw_target->get_depth_buffer().get_format();
+    if (!fits)
+        return false;
+
+    copy_target(*m_layer, *m_draw_target);
+
+    // every pixel got written, nothing the clear flagged is pending anymore
+    m_tiles.clear();
+    return true;
+}
+
+void SoftwareDevice::update_resolution()
+{
+    // NOTE: the whole period between flushes counts, the budget is for the frame and not only the drawing
+    const auto now = app_clock::now();
+    const float frame_time = std::chrono::duration<float>(now - m_frame_start).count();
+    const bool timed = m_frame_timed;
+    m_frame_start = now;
+    m_frame_timed = true;
+    if (!timed || !m_resolution.update(frame_time))
+        return;
+
+    dlog("Resolution scale %.3f", m_resolution.get_scale());
+    // pending clears of a target that stops being drawn to still go out with this frame
+    resolve_color();
+    update_draw_target();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -623,9 +2533,9 @@ unique_ptr<VertexBuffer> SoftwareDevice::create_vertex_buffer(unique_ptr<VertexD
     return ret;
 }
 
-unique_ptr<IndexBuffer> SoftwareDevice::create_index_buffer(size_t count)
+unique_ptr<IndexBuffer> SoftwareDevice::create_index_buffer(size_t count, IndexFormat format)
 {
-    auto ret = unique_ptr<IndexBuffer>{ new SoftwareIndexBuffer{ count } };
+    auto ret = unique_ptr<IndexBuffer>{ new SoftwareIndexBuffer{ count, format } };
     dlog("Created index buffer %#x", ret.get());
     return ret;
 }
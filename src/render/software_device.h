@@ -1,7 +1,9 @@
 #pragma once
 
 #include "render_system.h"
+#include "software_buffers.h"
 #include "material.h"
+#include "light_clusters.h"
 #include "scene/light.h"
 #include "math3.h"
 #include "misc.h"
@@ -37,10 +39,154 @@ namespace detail
         }
     };
 
+    struct make_pow_table
+    {
+        PowTable operator()(const float& exponent) const
+        {
+            return PowTable{ exponent };
+        }
+    };
+
     constexpr size_t SOFTWARE_TEXTURE_COUNT = 2;
-    constexpr size_t SOFTWARE_LIGHT_COUNT = 2;
+
+    // framebuffer tile size in pixels, both sides; granularity of the lazy clears and the depth planes
+    constexpr int FRAMEBUFFER_TILE_SIZE = 64;
+
+    // device z over the screen, z = a + b * x + c * y with x/y in pixels
+    struct DepthPlane
+    {
+        float a, b, c;
+    };
+
+    // already covered pixels [x0, x1) of a scanline and the plane of the triangle covering them
+    struct ScanlineSpan
+    {
+        int x0, x1;
+        DepthPlane plane;
+    };
+
+    enum class TileDepth : uint8_t
+    {
+        // the pixels hold the depth
+        Raw,
+        // clear pending, the pixels still hold whatever the previous frame left there
+        Clear,
+        // a single triangle covers the whole tile, only its plane is stored
+        Plane
+    };
+
+    struct FramebufferTile
+    {
+        bool color_clear;
+        TileDepth depth;
+        DepthPlane plane;
+    };
+
+    // shading result of the last block shaded in a column of coarse shading blocks
+    struct CoarseSample
+    {
+        // block row it belongs to, in block units; none yet
+        int block_y = -1;
+        float color[4] = {};
+        uint32_t rgba = 0;
+    };
+
+    // float capacity of the DevicePoint varyings: view position, normal, color and texcoord
+    constexpr size_t MAX_VARYINGS = 12;
+
+    // where each attribute sits in the varyings of a DevicePoint, negative when the draw doesnt have it
+    // NOTE: gouraud shaded draws carry the lighting terms in place of the view position and normal
+    struct VaryingLayout
+    {
+        int view_position = -1;
+        int view_normal = -1;
+        int light_additive = -1;
+        int light_diffuse = -1;
+        int color = -1;
+        int texcoord = -1;
+        size_t count = 0;
+
+        bool operator==(const VaryingLayout& rhs) const
+        {
+            return
+                view_position == rhs.view_position && view_normal == rhs.view_normal &&
+                light_additive == rhs.light_additive && light_diffuse == rhs.light_diffuse &&
+                color == rhs.color && texcoord == rhs.texcoord && count == rhs.count;
+        }
+
+        bool operator!=(const VaryingLayout& rhs) const
+        {
+            return !(*this == rhs);
+        }
+    };
+
+    // vertex before the perspective divide, all attributes still linear so they can be clipped
+    struct ClipVertex
+    {
+        vec4 position;
+        vec3 view_position;
+        vec3 view_normal;
+        Color color;
+        vec2 texcoord;
+    };
+
+    // dynamic resolution limits, scale is per side of the render target
+    constexpr float RESOLUTION_MIN_SCALE = 0.5f;
+    constexpr float RESOLUTION_SCALE_STEP = 1.0f / 16.0f;
+    // weight of the newest frame in the frame time average
+    constexpr float RESOLUTION_AVERAGE_WEIGHT = 0.1f;
+    // growing needs the predicted frame time this far under budget, keeps it from bouncing between 2 steps
+    constexpr float RESOLUTION_HEADROOM = 0.9f;
+    // frames to wait after a change before the average is trusted again
+    constexpr int RESOLUTION_SETTLE_FRAMES = 4;
+
+    // picks the draw resolution from a moving average of the frame time against a budget
+    // NOTE: assumes the frame cost goes with the pixel count, so the side scales by the root of the ratio;
+    // shrinking jumps straight to the estimate, growing goes a step at a time
+    class ResolutionController
+    {
+    public:
+        // seconds per frame, 0 turns the scaling off
+        void set_budget(float seconds);
+        // returns true when the scale changed
+        bool update(float frame_time);
+        float get_scale() const;
+
+    private:
+        float m_budget = 0.0f;
+        float m_average = 0.0f;
+        float m_scale = 1.0f;
+        int m_settle = 0;
+    };
 }
 
+enum class LightingQuality
+{
+    // libm pow and exact normalization
+    Accurate,
+    // specular lookup tables and fast approximations from math3
+    Fast
+};
+
+enum class PerspectiveMode
+{
+    // perspective divide on every pixel
+    Exact,
+    // divide every few pixels and step affinely in between, span length from the triangle depth range
+    Subdivided
+};
+
+enum class RasterMode
+{
+    // triangles drawn as they come, depth tested per pixel
+    DepthBuffer,
+    // filled triangles deferred until flush, then drawn front to back clipped against the
+    // already covered spans of each scanline, so hidden pixels dont get shaded and depth is never read
+    // NOTE: the spans keep the depth plane of their triangle, a new one only takes the pixels where it
+    // is nearer, so the front to back order just keeps the overdraw low
+    SpanBuffer
+};
+
 class SoftwareDevice : public RenderDevice
 {
 protected:
@@ -81,6 +227,11 @@ protected:
         const Color& get_material_emissive() const;
         float get_material_shininess() const;
         bool get_material_lighting() const;
+        TextureAddress get_material_texture_address() const;
+        ShadingMode get_material_shading_mode() const;
+        ShadingRate get_material_shading_rate() const;
+        const PowTable& get_material_specular_table();
+        const Material* get_material() const;
 
     private:
         mat4 m_world_matrix, m_world_inv_matrix;
@@ -94,20 +245,64 @@ protected:
         Color m_material_emissive;
         float m_material_shininess = 0.0f;
         bool m_material_lighting = false;
+        TextureAddress m_material_texture_address = TextureAddress::Clamp;
+        ShadingMode m_material_shading_mode = ShadingMode::Phong;
+        ShadingRate m_material_shading_rate = ShadingRate::Rate1x1;
+        const Material* m_material = nullptr;
 
         // computed stuff
         dirty_t<mat4, detail::make_mv> m_mv_matrix = { m_world_matrix, m_view_matrix };
         dirty_t<mat4, detail::make_mvp> m_mvp_matrix = { m_world_matrix, m_view_matrix, m_proj_matrix };
         dirty_t<mat3, detail::make_normal> m_normal_matrix = { m_view_inv_matrix, m_world_inv_matrix };
+        dirty_t<PowTable, detail::make_pow_table> m_specular_table = { m_material_shininess };
     };
 
     struct DevicePoint
     {
         vec4 position;
-        optional_t<vec3> view_position;
-        optional_t<vec3> view_normal;
-        optional_t<Color> color;
-        optional_t<vec2> texcoord;
+        // attributes divided by w, packed as the VaryingLayout of the draw says; only the first count are set
+        // NOTE: gouraud shading results are the light reaching the surface diffuse color and
+        // the additive (ambient + specular + emissive) part
+        std::array<float, detail::MAX_VARYINGS> varyings;
+    };
+
+    // state needed to draw a deferred triangle later on
+    struct DeferredState
+    {
+        const Material* material;
+        std::array<const Texture*, detail::SOFTWARE_TEXTURE_COUNT> texture_units;
+        // NOTE: kept here so that switching states while flushing doesnt rebuild the tables
+        PowTable specular_table;
+        bool has_specular_table;
+        detail::VaryingLayout varyings;
+    };
+
+    struct DeferredTri
+    {
+        DevicePoint points[3];
+        size_t state;
+        float depth;
+    };
+
+    // per draw state shared by the vertex stage and the clip stage
+    struct DrawState
+    {
+        // position dequantization folded in
+        mat4 mv_matrix;
+        mat4 mvp_matrix;
+        mat3 normal_matrix;
+        mat4 proj_matrix;
+        mat3x4 clip_matrix;
+
+        bool has_normals;
+        bool has_colors;
+        bool has_texcoords;
+        bool vertex_lighting;
+        const PowTable* spec_table;
+        detail::VaryingLayout varyings;
+
+        // guard band extent in clip-space w units
+        float guard_x, guard_y;
     };
 
 public:
@@ -122,43 +317,187 @@ public:
     void set_polygon_mode(PolygonMode mode) final;
     void set_render_target(RenderTarget* target) override;
     void set_texture_unit(size_t index, const Texture* texture) final;
-    void set_light_unit(size_t index, const Light* light) final;
+    void set_lights(const std::vector<const Light*>& lights) final;
     Params& get_params() final;
 
     // resource management methods
     std::unique_ptr<VertexBuffer> create_vertex_buffer(std::unique_ptr<VertexDecl> decl, size_t count) final;
-    std::unique_ptr<IndexBuffer> create_index_buffer(size_t count) final;
+    std::unique_ptr<IndexBuffer> create_index_buffer(size_t count, IndexFormat format) final;
     std::unique_ptr<Texture> create_texture(size_t width, size_t height, PixelFormat format) final;
 
     // capabilities methods
     size_t get_texture_unit_count() const final;
-    size_t get_light_unit_count() const final;
+
+    // quality settings
+    void set_lighting_quality(LightingQuality quality);
+    void set_perspective_mode(PerspectiveMode mode);
+    void set_raster_mode(RasterMode mode);
+    RasterMode get_raster_mode() const;
+    // NOTE: draws go to an offscreen buffer of this format that flush resolves into the render target,
+    // rgb565 for low bandwidth previews or rgba16f to accumulate hdr; the target format draws directly
+    void set_intermediate_format(ColorBufferFormat format);
+    // NOTE: when frames take longer than the budget draws go to a smaller intermediate that flush
+    // upscales into the render target, 0 always draws at full resolution
+    void set_frame_budget(float seconds);
+    float get_resolution_scale() const;
+
+    // framebuffer methods
+    void flush() final;
+    // NOTE: span buffer mode never reads depth, items drawn over a layer couldnt hide behind it,
+    // so there is no layer in that mode and everything gets drawn every frame
+    void store_layer() final;
+    bool restore_layer() final;
 
     // debug
     void debug_normals(bool enable);
 
 protected:
-    void draw_tri(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2);
-
-    // TODO: these 2 should also be software rendered
-    virtual void draw_points(const std::vector<DevicePoint>& points) = 0;
-    virtual void draw_lines(const std::vector<DevicePoint>& points) = 0;
-    void draw_fill(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2);
+    // vertex stage, instantiated per index type and vertex fetch (typed formats or the runtime decl)
+    template <typename Index, typename Fetch>
+    void draw_indexed(const Index* indices, const Fetch& fetch, const DrawState& state);
+    // clipping, projection and per vertex lighting of a triangle that passed the vertex stage
+    void draw_clipped(const detail::ClipVertex (&cv)[3], const DrawState& state);
+    // filled triangle, drawn right away or deferred depending on the raster mode
+    void draw_tri(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2, const detail::VaryingLayout& varyings);
+
+    // point/wireframe rasterization, depth tested; batched over a whole primitive
+    void draw_line_batch();
+    void draw_point_batch();
+
+    void draw_fill(
+        const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2,
+        const detail::VaryingLayout& varyings, const PowTable* spec_table, bool clip_spans
+    );
+    void defer_fill(const DevicePoint& p0, const DevicePoint& p1, const DevicePoint& p2, const detail::VaryingLayout& varyings);
+    // span buffer mode, draws the deferred triangles front to back
+    void draw_deferred();
+
+    // specular table for the current material, null when the accurate lighting path is used
+    const PowTable* get_specular_table();
+
+    // picks the target draws go to and keeps the intermediate in size with the render target;
+    // the platform clear runs it first since windows resize on their own
+    void update_draw_target();
+    void resolve_intermediate();
+    // times the frame that just got flushed, the new scale applies from the next one
+    void update_resolution();
+    // clip matrix of the params mapped to the draw target, that may be smaller than the render target
+    mat3x4 get_draw_clip_matrix() const;
+
+    // lazy clears of the current target: clear_tiles only flags every tile, draws resolve the tiles
+    // they touch before their first access and resolve_color clears the untouched color before present;
+    // depth nobody touched is never written, depth planes get expanded to pixels on resolve
+    void clear_tiles();
+    void resolve_tiles(int x0, int y0, int x1, int y1);
+    void resolve_color();
+    bool has_tiles();
 
 protected:
     SoftwareParams m_params;
 
     PolygonMode m_poly_mode = PolygonMode::Fill;
     RenderTarget* m_render_target;
+    // where the rasterizer writes, the render target itself or the intermediate in front of it
+    RenderTarget* m_draw_target;
     std::array<const Texture*, detail::SOFTWARE_TEXTURE_COUNT> m_texture_units;
 
-    std::array<vec3, detail::SOFTWARE_LIGHT_COUNT> m_light_view_positions;
-    std::array<const Light*, detail::SOFTWARE_LIGHT_COUNT> m_light_units;
+    LightClusters m_light_clusters;
 
     std::unique_ptr<RenderTarget> m_null_target;
+    LightingQuality m_lighting_quality = LightingQuality::Fast;
+    PerspectiveMode m_perspective_mode = PerspectiveMode::Subdivided;
+    RasterMode m_raster_mode = RasterMode::DepthBuffer;
     bool m_debug_normals = false;
+
+    bool m_intermediate_enable = false;
+    ColorBufferFormat m_intermediate_format = ColorBufferFormat::ARGB8;
+    std::unique_ptr<SoftwareRenderTarget> m_intermediate;
+
+    // static layer snapshot of the draw target
+    std::unique_ptr<SoftwareRenderTarget> m_layer;
+
+    // dynamic resolution
+    detail::ResolutionController m_resolution;
+    app_clock::time_point m_frame_start;
+    bool m_frame_timed = false;
+    // scratch for the upscale, the 2 source rows in rgba8 and the horizontal footprint per target pixel
+    std::vector<uint32_t> m_upscale_rows;
+    std::vector<int32_t> m_upscale_coords;
+
+    // span buffer mode
+    std::vector<DeferredState> m_deferred_states;
+    std::vector<DeferredTri> m_deferred_tris;
+    std::vector<size_t> m_deferred_order;
+    std::vector<std::vector<detail::ScanlineSpan>> m_covered_spans;
+    std::vector<detail::ScanlineSpan> m_visible_spans;
+
+    // device positions, line batch holds segment end point pairs
+    std::vector<vec4> m_line_batch;
+    std::vector<vec4> m_point_batch;
+
+    // framebuffer tile state, only valid for the target and size it was made for
+    const RenderTarget* m_tile_target = nullptr;
+    int m_tile_width = 0;
+    int m_tile_height = 0;
+    int m_tile_cols = 0;
+    std::vector<detail::FramebufferTile> m_tiles;
+    // tiles of the current triangle bounding box that take its depth plane
+    std::vector<uint8_t> m_plane_tiles;
+    // coarse shading results, one per block column of the current triangle bounding box
+    std::vector<detail::CoarseSample> m_coarse_samples;
+
+    // [first, last) index ranges of the meshlets that survived culling
+    std::vector<std::pair<size_t, size_t>> m_index_ranges;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// detail::ResolutionController impl
+///////////////////////////////////////////////////////////////////////////////
+inline void detail::ResolutionController::set_budget(float seconds)
+{
+    m_budget = seconds;
+    m_average = 0.0f;
+    m_settle = 0;
+}
+
+inline bool detail::ResolutionController::update(float frame_time)
+{
+    float scale = 1.0f;
+    if (m_budget > 0)
+    {
+        // first frame seeds the average
+        m_average = m_average > 0 ? m_average + (frame_time - m_average) * RESOLUTION_AVERAGE_WEIGHT : frame_time;
+        if (m_settle > 0)
+        {
+            m_settle--;
+            return false;
+        }
+
+        scale = m_scale;
+        const float grown = ::min(m_scale + RESOLUTION_SCALE_STEP, 1.0f);
+        if (m_average > m_budget)
+            scale = std::floor(m_scale * std::sqrt(m_budget / m_average) / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+        else if (m_average * (grown * grown) / (m_scale * m_scale) < m_budget * RESOLUTION_HEADROOM)
+            scale = grown;
+        scale = clamp(scale, RESOLUTION_MIN_SCALE, 1.0f);
+    }
+
+    if (scale == m_scale)
+        return false;
+
+    // NOTE: the old frames in the average get rescaled to the prediction for the new size,
+    // the settle frames then replace it with measurements
+    m_average *= (scale * scale) / (m_scale * m_scale);
+    m_scale = scale;
+    m_settle = RESOLUTION_SETTLE_FRAMES;
+    return true;
+}
+
+inline float detail::ResolutionController::get_scale() const
+{
+    return m_scale;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // SoftwareDevice::SoftwareState impl
 ///////////////////////////////////////////////////////////////////////////////
@@ -207,8 +546,15 @@ inline void SoftwareDevice::SoftwareParams::set_material(const Material& materia
     m_material_diffuse = material.get_diffuse();
     m_material_specular = material.get_specular();
     m_material_emissive = material.get_emissive();
+    // NOTE: only rebuild the specular table when switching between different shininess
+    if (m_material_shininess != material.get_shininess())
+        m_specular_table.set_dirty();
     m_material_shininess = material.get_shininess();
     m_material_lighting = material.get_lighting_enable();
+    m_material_texture_address = material.get_texture_address();
+    m_material_shading_mode = material.get_shading_mode();
+    m_material_shading_rate = material.get_shading_rate();
+    m_material = &material;
 }
 
 inline const mat4& SoftwareDevice::SoftwareParams::get_world_matrix() const
@@ -286,6 +632,31 @@ inline bool SoftwareDevice::SoftwareParams::get_material_lighting() const
     return m_material_lighting;
 }
 
+inline TextureAddress SoftwareDevice::SoftwareParams::get_material_texture_address() const
+{
+    return m_material_texture_address;
+}
+
+inline ShadingMode SoftwareDevice::SoftwareParams::get_material_shading_mode() const
+{
+    return m_material_shading_mode;
+}
+
+inline ShadingRate SoftwareDevice::SoftwareParams::get_material_shading_rate() const
+{
+    return m_material_shading_rate;
+}
+
+inline const PowTable& SoftwareDevice::SoftwareParams::get_material_specular_table()
+{
+    return m_specular_table.get();
+}
+
+inline const Material* SoftwareDevice::SoftwareParams::get_material() const
+{
+    return m_material;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // SoftwareDevice impl
 ///////////////////////////////////////////////////////////////////////////////
@@ -301,11 +672,13 @@ inline void SoftwareDevice::set_render_target(RenderTarget* target)
     if (!target)
     {
         m_render_target = m_null_target.get();
+        update_draw_target();
         log_info("Set render target to null");
         return;
     }
 
     m_render_target = target;
+    update_draw_target();
     log_info("Set render target %#x", target);
 }
 
@@ -316,14 +689,13 @@ inline void SoftwareDevice::set_texture_unit(size_t index, const Texture* textur
     m_texture_units[index] = texture;
 }
 
-inline void SoftwareDevice::set_light_unit(size_t index, const Light* light)
+inline void SoftwareDevice::set_lights(const std::vector<const Light*>& lights)
 {
-    if (index >= detail::SOFTWARE_LIGHT_COUNT)
-        throw std::runtime_error("invalid light unit index");
-
-    m_light_units[index] = light;
-    if (light)
-        m_light_view_positions[index] = vec3{ m_params.get_view_matrix() * light->get_position() };
+    m_light_clusters.build(
+        lights,
+        m_params.get_view_matrix(), m_params.get_proj_matrix(), get_draw_clip_matrix(),
+        m_draw_target->get_width(), m_draw_target->get_height()
+    );
 }
 
 inline RenderDevice::Params& SoftwareDevice::get_params()
@@ -336,9 +708,66 @@ inline size_t SoftwareDevice::get_texture_unit_count() const
     return detail::SOFTWARE_TEXTURE_COUNT;
 }
 
-inline size_t SoftwareDevice::get_light_unit_count() const
+inline void SoftwareDevice::set_lighting_quality(LightingQuality quality)
+{
+    m_lighting_quality = quality;
+}
+
+inline void SoftwareDevice::set_perspective_mode(PerspectiveMode mode)
+{
+    m_perspective_mode = mode;
+}
+
+inline void SoftwareDevice::set_raster_mode(RasterMode mode)
+{
+    // NOTE: anything deferred so far still gets drawn by the next flush
+    m_raster_mode = mode;
+}
+
+inline RasterMode SoftwareDevice::get_raster_mode() const
+{
+    return m_raster_mode;
+}
+
+inline void SoftwareDevice::set_intermediate_format(ColorBufferFormat format)
+{
+    // NOTE: takes effect on the next clear, a frame never gets split between targets
+    m_intermediate_enable = true;
+    m_intermediate_format = format;
+}
+
+inline void SoftwareDevice::set_frame_budget(float seconds)
+{
+    m_resolution.set_budget(seconds);
+}
+
+inline float SoftwareDevice::get_resolution_scale() const
+{
+    return m_resolution.get_scale();
+}
+
+inline mat3x4 SoftwareDevice::get_draw_clip_matrix() const
+{
+    mat3x4 clip = m_params.get_clip_matrix();
+    if (m_draw_target == m_render_target)
+        return clip;
+
+    // NOTE: the params map to render target pixels, the draw target covers the same area with fewer
+    const float scale_x = static_cast<float>(m_draw_target->get_width()) / m_render_target->get_width();
+    const float scale_y = static_cast<float>(m_draw_target->get_height()) / m_render_target->get_height();
+    for (int i = 0; i < 4; i++)
+    {
+        clip[0][i] *= scale_x;
+        clip[1][i] *= scale_y;
+    }
+    return clip;
+}
+
+inline const PowTable* SoftwareDevice::get_specular_table()
 {
-    return detail::SOFTWARE_LIGHT_COUNT;
+    if (!m_params.get_material_lighting() || m_lighting_quality != LightingQuality::Fast)
+        return nullptr;
+    return &m_params.get_material_specular_table();
 }
 
 inline void SoftwareDevice::debug_normals(bool enable)
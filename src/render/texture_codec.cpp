@@ -0,0 +1,138 @@
+
+#include "precompiled.h"
+#include "texture_codec.h"
+
+#include "math3.h"
+
+using namespace std;
+
+namespace
+{
+    inline uint16_t rgb565_pack(const vec3& c)
+    {
+        const uint16_t r = static_cast<uint16_t>(clamp(c.x(), 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+        const uint16_t g = static_cast<uint16_t>(clamp(c.y(), 0.0f, 255.0f) * (63.0f / 255.0f) + 0.5f);
+        const uint16_t b = static_cast<uint16_t>(clamp(c.z(), 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    inline vec3 rgb8_unpack(uint32_t c)
+    {
+        return vec3{
+            static_cast<float>(c & 0xff),
+            static_cast<float>((c >> 8) & 0xff),
+            static_cast<float>((c >> 16) & 0xff)
+        };
+    }
+
+    void encode_block(const vec3 (&texels)[16], uint8_t* dst)
+    {
+        // principal axis of the block colors thru a few power iterations on the covariance
+        vec3 mean;
+        for (auto& t : texels)
+            mean += t;
+        mean *= 1.0f / 16;
+
+        float cov[6] = { 0 };
+        for (auto& t : texels)
+        {
+            const vec3 d = t - mean;
+            cov[0] += d.x() * d.x(); cov[1] += d.x() * d.y(); cov[2] += d.x() * d.z();
+            cov[3] += d.y() * d.y(); cov[4] += d.y() * d.z(); cov[5] += d.z() * d.z();
+        }
+
+        vec3 axis = { 1.0f, 1.0f, 1.0f };
+        for (int i = 0; i < 4; i++)
+        {
+            axis = vec3{
+                cov[0] * axis.x() + cov[1] * axis.y() + cov[2] * axis.z(),
+                cov[1] * axis.x() + cov[3] * axis.y() + cov[4] * axis.z(),
+                cov[2] * axis.x() + cov[4] * axis.y() + cov[5] * axis.z()
+            };
+            const float len = axis.length();
+            if (len < 1e-6f)
+            {
+                axis = vec3{ 0.0f, 0.0f, 0.0f };
+                break;
+            }
+            axis *= 1.0f / len;
+        }
+
+        // endpoints are the extreme projections on the axis
+        float min_t = 0, max_t = 0;
+        for (auto& t : texels)
+        {
+            const float proj = (t - mean) * axis;
+            min_t = std::min(min_t, proj);
+            max_t = std::max(max_t, proj);
+        }
+
+        uint16_t c0 = rgb565_pack(mean + axis * max_t);
+        uint16_t c1 = rgb565_pack(mean + axis * min_t);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t bits = 0;
+        if (c0 != c1)
+        {
+            // 4-color mode palette, same as the decoder would compute it
+            const uint32_t e0 = detail::rgb565_expand(c0);
+            const uint32_t e1 = detail::rgb565_expand(c1);
+            const vec3 palette[4] =
+            {
+                rgb8_unpack(e0),
+                rgb8_unpack(e1),
+                rgb8_unpack(detail::rgb8_blend(e0, e1, 2, 1, 3)),
+                rgb8_unpack(detail::rgb8_blend(e0, e1, 1, 2, 3))
+            };
+
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t best = 0;
+                float best_dist = std::numeric_limits<float>::max();
+                for (uint32_t j = 0; j < 4; j++)
+                {
+                    const float dist = (texels[i] - palette[j]).length_sq();
+                    if (dist < best_dist)
+                    {
+                        best = j;
+                        best_dist = dist;
+                    }
+                }
+                bits |= best << (2 * i);
+            }
+        }
+
+        dst[0] = static_cast<uint8_t>(c0);
+        dst[1] = static_cast<uint8_t>(c0 >> 8);
+        dst[2] = static_cast<uint8_t>(c1);
+        dst[3] = static_cast<uint8_t>(c1 >> 8);
+        dst[4] = static_cast<uint8_t>(bits);
+        dst[5] = static_cast<uint8_t>(bits >> 8);
+        dst[6] = static_cast<uint8_t>(bits >> 16);
+        dst[7] = static_cast<uint8_t>(bits >> 24);
+    }
+}
+
+void bc1_encode(const uint8_t* src, size_t elem_size, size_t width, size_t height, uint8_t* dst)
+{
+    for (size_t by = 0; by < height; by += 4)
+    {
+        for (size_t bx = 0; bx < width; bx += 4, dst += BC1_BLOCK_SIZE)
+        {
+            vec3 texels[16];
+            for (size_t y = 0; y < 4; y++)
+            {
+                for (size_t x = 0; x < 4; x++)
+                {
+                    // partial blocks on the image edges repeat the last row/column
+                    const size_t sx = std::min(bx + x, width - 1);
+                    const size_t sy = std::min(by + y, height - 1);
+                    const uint8_t* p = src + (sy * width + sx) * elem_size;
+                    texels[y * 4 + x] = vec3{ static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]) };
+                }
+            }
+            encode_block(texels, dst);
+        }
+    }
+}
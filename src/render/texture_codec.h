@@ -0,0 +1,73 @@
+#pragma once
+
+// NOTE: BC1 (aka DXT1) stores each 4x4 texel block in 8 bytes: two rgb565 endpoints
+// followed by 16 2-bit palette indices, row-major inside the block. This is a 4bpp format,
+// so it's 8x smaller than the rgba storage used by the uncompressed textures.
+constexpr size_t BC1_BLOCK_SIZE = 8;
+
+// encode a tightly packed rgb8/rgba8 image (elem_size 3 or 4) into bc1 blocks; alpha is dropped
+void bc1_encode(const uint8_t* src, size_t elem_size, size_t width, size_t height, uint8_t* dst);
+
+// decode a single texel from the bc1 block data, returned as packed rgba8 (r in lowest byte)
+inline uint32_t bc1_decode(const uint8_t* blocks, size_t width, size_t x, size_t y);
+
+inline size_t bc1_get_data_size(size_t width, size_t height);
+
+///////////////////////////////////////////////////////////////////////////////
+// impl
+///////////////////////////////////////////////////////////////////////////////
+namespace detail
+{
+    inline uint32_t rgb565_expand(uint32_t c)
+    {
+        const uint32_t r = (c >> 11) & 0x1f;
+        const uint32_t g = (c >> 5) & 0x3f;
+        const uint32_t b = c & 0x1f;
+        return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16);
+    }
+
+    // per-channel (a * wa + b * wb) / div on packed rgb8
+    inline uint32_t rgb8_blend(uint32_t a, uint32_t b, uint32_t wa, uint32_t wb, uint32_t div)
+    {
+        uint32_t ret = 0;
+        for (uint32_t shift = 0; shift < 24; shift += 8)
+        {
+            const uint32_t ca = (a >> shift) & 0xff;
+            const uint32_t cb = (b >> shift) & 0xff;
+            ret |= ((ca * wa + cb * wb) / div) << shift;
+        }
+        return ret;
+    }
+}
+
+inline uint32_t bc1_decode(const uint8_t* blocks, size_t width, size_t x, size_t y)
+{
+    const size_t blocks_per_row = (width + 3) / 4;
+    const uint8_t* block = blocks + ((y >> 2) * blocks_per_row + (x >> 2)) * BC1_BLOCK_SIZE;
+
+    const uint32_t c0 = block[0] | (block[1] << 8);
+    const uint32_t c1 = block[2] | (block[3] << 8);
+    const uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+    const uint32_t index = (bits >> (2 * (((y & 3) << 2) | (x & 3)))) & 3;
+
+    // only the palette entry that is actually referenced gets expanded
+    switch (index)
+    {
+        case 0: return detail::rgb565_expand(c0) | 0xff000000;
+        case 1: return detail::rgb565_expand(c1) | 0xff000000;
+        case 2:
+            if (c0 > c1)
+                return detail::rgb8_blend(detail::rgb565_expand(c0), detail::rgb565_expand(c1), 2, 1, 3) | 0xff000000;
+            return detail::rgb8_blend(detail::rgb565_expand(c0), detail::rgb565_expand(c1), 1, 1, 2) | 0xff000000;
+        default:
+            if (c0 > c1)
+                return detail::rgb8_blend(detail::rgb565_expand(c0), detail::rgb565_expand(c1), 1, 2, 3) | 0xff000000;
+            // 3-color mode, transparent black
+            return 0;
+    }
+}
+
+inline size_t bc1_get_data_size(size_t width, size_t height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * BC1_BLOCK_SIZE;
+}
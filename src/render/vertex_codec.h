@@ -0,0 +1,105 @@
+#pragma once
+
+#include "math3.h"
+
+// NOTE: compact vertex attribute encodings, components are native endian:
+// - snorm16 maps [-1, 1] to [-32767, 32767], positions get a per-mesh scale/offset so the object
+//   bounds use the whole range
+// - unorm16 maps [0, 1] to [0, 65535]
+// - oct16 folds a unit normal onto the octahedron and stores the 2d result as 2 snorm16, 4 bytes
+//   instead of 12 with under 0.05 degrees of error
+// - rgba8 is the 8bit per channel color, r in the lowest byte
+inline int16_t snorm16_encode(float value);
+inline float snorm16_decode(int16_t value);
+
+inline uint16_t unorm16_encode(float value);
+inline float unorm16_decode(uint16_t value);
+
+inline void oct16_encode(const vec3& normal, int16_t* out);
+inline vec3 oct16_decode(const int16_t* in);
+
+inline uint32_t rgba8_encode(const Color& color);
+inline Color rgba8_decode(uint32_t rgba);
+
+///////////////////////////////////////////////////////////////////////////////
+// impl
+///////////////////////////////////////////////////////////////////////////////
+inline int16_t snorm16_encode(float value)
+{
+    return static_cast<int16_t>(std::lround(clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+inline float snorm16_decode(int16_t value)
+{
+    return ::max(value * (1.0f / 32767.0f), -1.0f);
+}
+
+inline uint16_t unorm16_encode(float value)
+{
+    return static_cast<uint16_t>(std::lround(clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+inline float unorm16_decode(uint16_t value)
+{
+    return value * (1.0f / 65535.0f);
+}
+
+inline void oct16_encode(const vec3& normal, int16_t* out)
+{
+    const float l1 = std::abs(normal.x()) + std::abs(normal.y()) + std::abs(normal.z());
+    if (l1 <= 0)
+    {
+        out[0] = out[1] = 0;
+        return;
+    }
+
+    float x = normal.x() / l1;
+    float y = normal.y() / l1;
+    if (normal.z() < 0)
+    {
+        // lower hemisphere folds over the diagonals
+        const float fx = (1.0f - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+        const float fy = (1.0f - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+
+    out[0] = snorm16_encode(x);
+    out[1] = snorm16_encode(y);
+}
+
+inline vec3 oct16_decode(const int16_t* in)
+{
+    float x = snorm16_decode(in[0]);
+    float y = snorm16_decode(in[1]);
+    const float z = 1.0f - std::abs(x) - std::abs(y);
+
+    if (z < 0)
+    {
+        const float fx = (1.0f - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+        const float fy = (1.0f - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+
+    return vec3{ x, y, z }.normalize();
+}
+
+inline uint32_t rgba8_encode(const Color& color)
+{
+    uint32_t ret = 0;
+    for (int i = 0; i < 4; i++)
+        ret |= static_cast<uint32_t>(std::lround(clamp(color[i], 0.0f, 1.0f) * 255.0f)) << (i * 8);
+    return ret;
+}
+
+inline Color rgba8_decode(uint32_t rgba)
+{
+    constexpr float norm = 1.0f / 255.0f;
+    return Color{
+        (rgba & 0xff) * norm,
+        ((rgba >> 8) & 0xff) * norm,
+        ((rgba >> 16) & 0xff) * norm,
+        (rgba >> 24) * norm
+    };
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+#include "render_buffers.h"
+#include "vertex_codec.h"
+#include "misc.h"
+
+// NOTE: typed vertex formats, Vertex<Attrs...> lists its attributes in declaration order so
+// which ones exist, how each one is stored and where it lives are all compile-time constants.
+// The decl made from a format carries its id, devices use that to pick a vertex stage
+// instantiated for the format instead of scanning the decl and branching per vertex.
+namespace vertex
+{
+    // positions in the [-1, 1] box, the buffer position transform maps them back
+    struct PositionS16
+    {
+        using value_type = vec3;
+        static constexpr VertexSemantic semantic = VertexSemantic::Position;
+        static constexpr VertexType type = VertexType::Short4N;
+        static constexpr size_t size = 4 * sizeof(int16_t);
+
+        static vec3 load(const uint8_t* ptr);
+        static void store(uint8_t* ptr, const vec3& value);
+    };
+
+    struct NormalOct16
+    {
+        using value_type = vec3;
+        static constexpr VertexSemantic semantic = VertexSemantic::Normal;
+        static constexpr VertexType type = VertexType::Oct16;
+        static constexpr size_t size = 2 * sizeof(int16_t);
+
+        static vec3 load(const uint8_t* ptr);
+        static void store(uint8_t* ptr, const vec3& value);
+    };
+
+    struct ColorU8
+    {
+        using value_type = Color;
+        static constexpr VertexSemantic semantic = VertexSemantic::Color;
+        static constexpr VertexType type = VertexType::ColorU8;
+        static constexpr size_t size = sizeof(uint32_t);
+
+        static Color load(const uint8_t* ptr);
+        static void store(uint8_t* ptr, const Color& value);
+    };
+
+    struct TexcoordU16
+    {
+        using value_type = vec2;
+        static constexpr VertexSemantic semantic = VertexSemantic::Texcoord;
+        static constexpr VertexType type = VertexType::UShort2N;
+        static constexpr size_t size = 2 * sizeof(uint16_t);
+
+        static vec2 load(const uint8_t* ptr);
+        static void store(uint8_t* ptr, const vec2& value);
+    };
+
+    // tiled texcoords, outside of what unorm16 covers
+    struct TexcoordF32
+    {
+        using value_type = vec2;
+        static constexpr VertexSemantic semantic = VertexSemantic::Texcoord;
+        static constexpr VertexType type = VertexType::Float2;
+        static constexpr size_t size = 2 * sizeof(float);
+
+        static vec2 load(const uint8_t* ptr);
+        static void store(uint8_t* ptr, const vec2& value);
+    };
+
+    // stands in for an attribute the format doesnt have, loads as zero
+    template <typename T>
+    struct Absent
+    {
+        using value_type = T;
+        static constexpr size_t size = 0;
+    };
+}
+
+namespace detail
+{
+    template <VertexSemantic S, typename Default, typename... Attrs>
+    struct find_attr
+    {
+        using type = Default;
+    };
+
+    template <VertexSemantic S, typename Default, typename Attr, typename... Rest>
+    struct find_attr<S, Default, Attr, Rest...>
+    {
+        using type = std::conditional_t<Attr::semantic == S, Attr, typename find_attr<S, Default, Rest...>::type>;
+    };
+}
+
+template <typename... Attrs>
+class Vertex
+{
+public:
+    static constexpr size_t count = sizeof...(Attrs);
+
+    // attribute with the given semantic, Absent<Default> if there is none
+    template <VertexSemantic S, typename Default>
+    using find_t = typename detail::find_attr<S, vertex::Absent<Default>, Attrs...>::type;
+
+    template <VertexSemantic S>
+    static constexpr bool has();
+
+    // position of the attribute in the list, also its stream in the deinterleaved layout
+    template <typename Attr>
+    static constexpr size_t index();
+
+    // byte offset of the attribute at index in the interleaved layout
+    static constexpr size_t offset(size_t index);
+
+    static constexpr size_t size();
+
+    static const void* get_format_id();
+    static std::unique_ptr<VertexDecl> make_decl(VertexLayout layout);
+};
+
+// per attribute addressing of a typed format inside the buffer data, Ptr is the (const) byte pointer
+template <typename V, typename Ptr>
+class VertexView
+{
+public:
+    VertexView(Ptr data, const VertexBuffer& vb);
+
+    template <typename Attr>
+    typename Attr::value_type load(size_t index) const;
+
+    template <typename Attr>
+    void store(size_t index, const typename Attr::value_type& value) const;
+
+private:
+    // absent attributes load as zero and ignore stores
+    template <typename T>
+    T load(size_t, vertex::Absent<T>) const;
+    template <typename T>
+    void store(size_t, const T&, vertex::Absent<T>) const;
+
+    template <typename Attr>
+    typename Attr::value_type load(size_t index, Attr) const;
+    template <typename Attr>
+    void store(size_t index, const typename Attr::value_type& value, Attr) const;
+
+private:
+    std::array<Ptr, V::count> m_base;
+    std::array<size_t, V::count> m_stride;
+};
+
+// every attribute combination a mesh can be built with
+using MeshVertexFormats = std::tuple<
+    Vertex<vertex::PositionS16>,
+    Vertex<vertex::PositionS16, vertex::NormalOct16>,
+    Vertex<vertex::PositionS16, vertex::ColorU8>,
+    Vertex<vertex::PositionS16, vertex::NormalOct16, vertex::ColorU8>,
+    Vertex<vertex::PositionS16, vertex::TexcoordU16>,
+    Vertex<vertex::PositionS16, vertex::NormalOct16, vertex::TexcoordU16>,
+    Vertex<vertex::PositionS16, vertex::ColorU8, vertex::TexcoordU16>,
+    Vertex<vertex::PositionS16, vertex::NormalOct16, vertex::ColorU8, vertex::TexcoordU16>,
+    Vertex<vertex::PositionS16, vertex::TexcoordF32>,
+    Vertex<vertex::PositionS16, vertex::NormalOct16, vertex::TexcoordF32>,
+    Vertex<vertex::PositionS16, vertex::ColorU8, vertex::TexcoordF32>,
+    Vertex<vertex::PositionS16, vertex::NormalOct16, vertex::ColorU8, vertex::TexcoordF32>
+>;
+
+// calls fun(V{}) for every format V in the tuple
+template <typename Formats, typename Func>
+void for_each_vertex_format(Func&& fun);
+
+///////////////////////////////////////////////////////////////////////////////
+// vertex attributes impl
+///////////////////////////////////////////////////////////////////////////////
+inline vec3 vertex::PositionS16::load(const uint8_t* ptr)
+{
+    const int16_t* p = reinterpret_cast<const int16_t*>(ptr);
+    return vec3{ snorm16_decode(p[0]), snorm16_decode(p[1]), snorm16_decode(p[2]) };
+}
+
+inline void vertex::PositionS16::store(uint8_t* ptr, const vec3& value)
+{
+    int16_t* p = reinterpret_cast<int16_t*>(ptr);
+    p[0] = snorm16_encode(value.x());
+    p[1] = snorm16_encode(value.y());
+    p[2] = snorm16_encode(value.z());
+    p[3] = 0;
+}
+
+inline vec3 vertex::NormalOct16::load(const uint8_t* ptr)
+{
+    return oct16_decode(reinterpret_cast<const int16_t*>(ptr));
+}
+
+inline void vertex::NormalOct16::store(uint8_t* ptr, const vec3& value)
+{
+    oct16_encode(value, reinterpret_cast<int16_t*>(ptr));
+}
+
+inline Color vertex::ColorU8::load(const uint8_t* ptr)
+{
+    uint32_t rgba;
+    std::memcpy(&rgba, ptr, sizeof(rgba));
+    return rgba8_decode(rgba);
+}
+
+inline void vertex::ColorU8::store(uint8_t* ptr, const Color& value)
+{
+    const uint32_t rgba = rgba8_encode(value);
+    std::memcpy(ptr, &rgba, sizeof(rgba));
+}
+
+inline vec2 vertex::TexcoordU16::load(const uint8_t* ptr)
+{
+    const uint16_t* p = reinterpret_cast<const uint16_t*>(ptr);
+    return vec2{ unorm16_decode(p[0]), unorm16_decode(p[1]) };
+}
+
+inline void vertex::TexcoordU16::store(uint8_t* ptr, const vec2& value)
+{
+    uint16_t* p = reinterpret_cast<uint16_t*>(ptr);
+    p[0] = unorm16_encode(value.x());
+    p[1] = unorm16_encode(value.y());
+}
+
+inline vec2 vertex::TexcoordF32::load(const uint8_t* ptr)
+{
+    const float* p = reinterpret_cast<const float*>(ptr);
+    return vec2{ p[0], p[1] };
+}
+
+inline void vertex::TexcoordF32::store(uint8_t* ptr, const vec2& value)
+{
+    float* p = reinterpret_cast<float*>(ptr);
+    p[0] = value.x();
+    p[1] = value.y();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex impl
+///////////////////////////////////////////////////////////////////////////////
+template <typename... Attrs>
+template <VertexSemantic S>
+inline constexpr bool Vertex<Attrs...>::has()
+{
+    return find_t<S, void>::size > 0;
+}
+
+template <typename... Attrs>
+template <typename Attr>
+inline constexpr size_t Vertex<Attrs...>::index()
+{
+    return typelist_index<Attr, Attrs...>::value;
+}
+
+template <typename... Attrs>
+inline constexpr size_t Vertex<Attrs...>::offset(size_t index)
+{
+    const size_t sizes[] = { Attrs::size... };
+
+    size_t ret = 0;
+    for (size_t i = 0; i < index; i++)
+        ret += sizes[i];
+    return ret;
+}
+
+template <typename... Attrs>
+inline constexpr size_t Vertex<Attrs...>::size()
+{
+    const size_t sizes[] = { Attrs::size... };
+
+    size_t ret = 0;
+    for (auto s : sizes)
+        ret += s;
+    return ret;
+}
+
+template <typename... Attrs>
+inline const void* Vertex<Attrs...>::get_format_id()
+{
+    // NOTE: one per instantiation, the address is the id
+    static const char id = 0;
+    return &id;
+}
+
+template <typename... Attrs>
+inline std::unique_ptr<VertexDecl> Vertex<Attrs...>::make_decl(VertexLayout layout)
+{
+    std::unique_ptr<VertexDecl> decl(new VertexDecl{ layout, get_format_id() });
+
+    using swallow = int[];
+    (void)swallow{ (decl->add(Attrs::type, Attrs::semantic), 0)... };
+    return decl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// VertexView impl
+///////////////////////////////////////////////////////////////////////////////
+template <typename V, typename Ptr>
+inline VertexView<V, Ptr>::VertexView(Ptr data, const VertexBuffer& vb)
+{
+    const VertexDecl& decl = vb.get_declaration();
+    const bool interleaved = decl.get_layout() == VertexLayout::Interleaved;
+
+    // NOTE: element order matches the attribute order, so the streams are known without the decl elements
+    for (size_t i = 0; i < V::count; i++)
+    {
+        m_base[i] = interleaved ? data + V::offset(i) : data + vb.get_stream_offset(i);
+        m_stride[i] = interleaved ? V::size() : decl.get_stride(i);
+    }
+}
+
+template <typename V, typename Ptr>
+template <typename Attr>
+inline typename Attr::value_type VertexView<V, Ptr>::load(size_t index) const
+{
+    return load(index, Attr{});
+}
+
+template <typename V, typename Ptr>
+template <typename T>
+inline T VertexView<V, Ptr>::load(size_t, vertex::Absent<T>) const
+{
+    return T{};
+}
+
+template <typename V, typename Ptr>
+template <typename Attr>
+inline typename Attr::value_type VertexView<V, Ptr>::load(size_t index, Attr) const
+{
+    constexpr size_t i = V::template index<Attr>();
+    return Attr::load(m_base[i] + index * m_stride[i]);
+}
+
+template <typename V, typename Ptr>
+template <typename Attr>
+inline void VertexView<V, Ptr>::store(size_t index, const typename Attr::value_type& value) const
+{
+    store(index, value, Attr{});
+}
+
+template <typename V, typename Ptr>
+template <typename T>
+inline void VertexView<V, Ptr>::store(size_t, const T&, vertex::Absent<T>) const
+{}
+
+template <typename V, typename Ptr>
+template <typename Attr>
+inline void VertexView<V, Ptr>::store(size_t index, const typename Attr::value_type& value, Attr) const
+{
+    constexpr size_t i = V::template index<Attr>();
+    Attr::store(m_base[i] + index * m_stride[i], value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// format list impl
+///////////////////////////////////////////////////////////////////////////////
+namespace detail
+{
+    template <typename Formats, typename Func, size_t... I>
+    inline void for_each_vertex_format_impl(Func&& fun, std::index_sequence<I...>)
+    {
+        using swallow = int[];
+        (void)swallow{ (fun(std::tuple_element_t<I, Formats>{}), 0)... };
+    }
+}
+
+template <typename Formats, typename Func>
+inline void for_each_vertex_format(Func&& fun)
+{
+    detail::for_each_vertex_format_impl<Formats>(
+        std::forward<Func>(fun),
+        std::make_index_sequence<std::tuple_size<Formats>::value>{}
+    );
+}
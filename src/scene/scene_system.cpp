@@ -46,6 +46,13 @@ namespace
     {
         throw std::runtime_error("Attempted to use null viewport");
     }
+
+    // exact match, any change at all has to show
+    template <typename T>
+    inline bool same_bits(const T& lhs, const T& rhs)
+    {
+        return std::memcmp(&lhs, &rhs, sizeof(T)) == 0;
+    }
 }
 
 SceneSystem::SceneSystem(QkEngine::Context& context) :
@@ -77,22 +84,41 @@ void SceneSystem::process()
     p.set_clip_matrix(m_viewport->get_clip());
     p.set_view_inv_matrix(m_camera->get_view_inv());
 
+    if (!same_bits(m_static_view, m_camera->get_view()) || !same_bits(m_static_proj, m_camera->get_proj()) ||
+        !same_bits(m_static_clip, m_viewport->get_clip()))
+    {
+        m_static_view = m_camera->get_view();
+        m_static_proj = m_camera->get_proj();
+        m_static_clip = m_viewport->get_clip();
+        m_static_version++;
+    }
+
     // set lights
-    auto& dev = render.get_device();
-    for (size_t i = 0; i < dev.get_light_unit_count(); i++)
-        dev.set_light_unit(i, i < m_lights.size() ? m_lights[i] : nullptr);
+    render.get_device().set_lights(m_lights);
 
     // add items in render queue
     auto& q = render.get_queue();
     q.clear();
+    m_static_items_next.clear();
 
     for (const auto& agg : m_context.get_entity().filter_comp<SrtComponent, ModelComponent>())
     {
         auto& srt = std::get<0>(agg);
         auto& model = std::get<1>(agg);
 
+        if (srt.is_static())
+            m_static_items_next.emplace_back(&srt, srt.get_version());
+
         // TODO: add any visibility algorithms here
         for (const auto& unit : model.get_model()->get_units())
-            q.add(srt.get_world(), srt.get_world_inv(), unit);
+            q.add(srt.get_world(), srt.get_world_inv(), unit, srt.is_static());
+    }
+
+    // static entities that moved, showed up or went away
+    if (m_static_items_next != m_static_items)
+    {
+        std::swap(m_static_items, m_static_items_next);
+        m_static_version++;
     }
+    q.set_static_version(m_static_version);
 }
@@ -2,10 +2,12 @@
 
 #include "engine.h"
 #include "subsystem.h"
+#include "math3.h"
 
 class Camera;
 class Viewport;
 class Light;
+class SrtComponent;
 
 class SceneSystem : public Subsystem
 {
@@ -29,6 +31,14 @@ private:
 
     std::unique_ptr<Camera> m_null_camera;
     std::unique_ptr<Viewport> m_null_viewport;
+
+    // static layer tracking, the view and the static entities with their versions of the last frame
+    // NOTE: lights are only tracked thru set_lights, changing one in place needs a layer invalidate
+    uint32_t m_static_version = 0;
+    mat4 m_static_view, m_static_proj;
+    mat3x4 m_static_clip;
+    std::vector<std::pair<const SrtComponent*, uint32_t>> m_static_items;
+    std::vector<std::pair<const SrtComponent*, uint32_t>> m_static_items_next;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -67,4 +77,5 @@ inline void SceneSystem::set_viewport(const Viewport* viewport)
 inline void SceneSystem::set_lights(const Lights& lights)
 {
     m_lights = lights;
+    m_static_version++;
 }